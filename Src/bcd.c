@@ -0,0 +1,64 @@
+//****************************************************************************************************************
+//
+// Преобразование значений в упакованном BCD формате (ответы счетчика Меркурий)
+//
+//****************************************************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bcd.h"
+
+//****************************************************************************************************************
+// Таблица преобразования байта в упакованном BCD формате в число 0-99,
+// BCD_INVALID - байт содержит недопустимую тетраду (A-F)
+//****************************************************************************************************************
+#define BCD_INVALID             0xFF
+#define BCD_ROW( h )            h*10+0, h*10+1, h*10+2, h*10+3, h*10+4, h*10+5, h*10+6, h*10+7, h*10+8, h*10+9, \
+                                BCD_INVALID, BCD_INVALID, BCD_INVALID, BCD_INVALID, BCD_INVALID, BCD_INVALID
+#define BCD_ROW_INVALID         BCD_INVALID, BCD_INVALID, BCD_INVALID, BCD_INVALID, BCD_INVALID, BCD_INVALID, \
+                                BCD_INVALID, BCD_INVALID, BCD_INVALID, BCD_INVALID, BCD_INVALID, BCD_INVALID, \
+                                BCD_INVALID, BCD_INVALID, BCD_INVALID, BCD_INVALID
+static const uint8_t bcd_value[256] = {
+    BCD_ROW( 0 ), BCD_ROW( 1 ), BCD_ROW( 2 ), BCD_ROW( 3 ), BCD_ROW( 4 ), 
+    BCD_ROW( 5 ), BCD_ROW( 6 ), BCD_ROW( 7 ), BCD_ROW( 8 ), BCD_ROW( 9 ),
+    BCD_ROW_INVALID, BCD_ROW_INVALID, BCD_ROW_INVALID, BCD_ROW_INVALID, BCD_ROW_INVALID, BCD_ROW_INVALID
+ };
+
+//****************************************************************************************************************
+// Преобразует значения в упакованном BCD формате в челое число (аналог функции atoi())
+// Байт преобразуется в две десятичные цифры по таблице bcd_value[], 
+// допустимость тетрад проверяется заранее, см. BCDCheck()
+// uint8_t *ptr     - указатель на первый (старший байт) числа
+// uint8_t cnt_byte - кол-во байт для преобразования
+// return           - преобразованное число
+//****************************************************************************************************************
+uint32_t BCDToInt( uint8_t *ptr, uint8_t cnt_byte ) {
+
+    uint8_t value;
+    uint32_t result = 0;
+  
+    for ( ; cnt_byte; cnt_byte--, ptr++ ) {
+        value = bcd_value[*ptr];
+        if ( value == BCD_INVALID )
+            value = 0;
+        result = result * 100 + value;
+       }
+    return result;
+ }
+
+//****************************************************************************************************************
+// Проверка значений в упакованном BCD формате на допустимые тетрады (0-9)
+// uint8_t *ptr     - указатель на данные
+// uint8_t cnt_byte - кол-во байт для проверки
+// return = true    - все байты содержат допустимые значения
+//          false   - обнаружена недопустимая тетрада (A-F)
+//****************************************************************************************************************
+bool BCDCheck( uint8_t *ptr, uint8_t cnt_byte ) {
+
+    for ( ; cnt_byte; cnt_byte--, ptr++ ) {
+        if ( bcd_value[*ptr] == BCD_INVALID )
+            return false;
+       }
+    return true;
+ }
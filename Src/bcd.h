@@ -0,0 +1,10 @@
+#ifndef __BCD_H
+#define __BCD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+uint32_t BCDToInt( uint8_t *ptr, uint8_t cnt_byte );
+bool BCDCheck( uint8_t *ptr, uint8_t cnt_byte );
+
+#endif
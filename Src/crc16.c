@@ -10,47 +10,79 @@
 
 #include "crc16.h"
 
-static uint8_t table_high[] = {
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
-    0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-    0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
-    0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81,
-    0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01,
-    0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
-    0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-    0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
-    0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-    0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
-    0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01,
-    0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
-    0x40
-   };
+//****************************************************************************************************************
+// Таблицы расчета формируются препроцессором при компиляции. Значение таблицы - регистр КС после
+// сдвигов по полиному MODBUS 0xA001 (0x8005 в обратном порядке бит). Расчет линейный: значение для
+// индекса равно XOR значений для единичных бит индекса (базисных значений), см. CRC16_VALUE()
+//****************************************************************************************************************
+#define CRC16_POLY          0xA001
+
+//сдвиг регистра КС на 1, 4, 8 бит
+#define CRC16_S1( c )       ( ( (c) >> 1 ) ^ ( ( (c) & 1 ) ? CRC16_POLY : 0 ) )
+#define CRC16_S4( c )       CRC16_S1( CRC16_S1( CRC16_S1( CRC16_S1( c ) ) ) )
+#define CRC16_S8( c )       CRC16_S4( CRC16_S4( c ) )
+
+//базисные значения таблицы k: КС байта с одним единичным битом, за которым следуют k нулевых байт
+enum {
+    CRC16_B0_0 = CRC16_S8( 0x01 ), CRC16_B0_1 = CRC16_S8( 0x02 ), CRC16_B0_2 = CRC16_S8( 0x04 ),
+    CRC16_B0_3 = CRC16_S8( 0x08 ), CRC16_B0_4 = CRC16_S8( 0x10 ), CRC16_B0_5 = CRC16_S8( 0x20 ),
+    CRC16_B0_6 = CRC16_S8( 0x40 ), CRC16_B0_7 = CRC16_S8( 0x80 ),
+#if CRC16_ENGINE == CRC16_ENGINE_SLICE4
+    CRC16_B1_0 = CRC16_S8( CRC16_B0_0 ), CRC16_B1_1 = CRC16_S8( CRC16_B0_1 ), CRC16_B1_2 = CRC16_S8( CRC16_B0_2 ),
+    CRC16_B1_3 = CRC16_S8( CRC16_B0_3 ), CRC16_B1_4 = CRC16_S8( CRC16_B0_4 ), CRC16_B1_5 = CRC16_S8( CRC16_B0_5 ),
+    CRC16_B1_6 = CRC16_S8( CRC16_B0_6 ), CRC16_B1_7 = CRC16_S8( CRC16_B0_7 ),
+    CRC16_B2_0 = CRC16_S8( CRC16_B1_0 ), CRC16_B2_1 = CRC16_S8( CRC16_B1_1 ), CRC16_B2_2 = CRC16_S8( CRC16_B1_2 ),
+    CRC16_B2_3 = CRC16_S8( CRC16_B1_3 ), CRC16_B2_4 = CRC16_S8( CRC16_B1_4 ), CRC16_B2_5 = CRC16_S8( CRC16_B1_5 ),
+    CRC16_B2_6 = CRC16_S8( CRC16_B1_6 ), CRC16_B2_7 = CRC16_S8( CRC16_B1_7 ),
+    CRC16_B3_0 = CRC16_S8( CRC16_B2_0 ), CRC16_B3_1 = CRC16_S8( CRC16_B2_1 ), CRC16_B3_2 = CRC16_S8( CRC16_B2_2 ),
+    CRC16_B3_3 = CRC16_S8( CRC16_B2_3 ), CRC16_B3_4 = CRC16_S8( CRC16_B2_4 ), CRC16_B3_5 = CRC16_S8( CRC16_B2_5 ),
+    CRC16_B3_6 = CRC16_S8( CRC16_B2_6 ), CRC16_B3_7 = CRC16_S8( CRC16_B2_7 ),
+#endif
+ };
+
+//значение таблицы k для индекса n
+#define CRC16_VALUE( k, n ) ( ( (n) & 0x01 ? CRC16_B##k##_0 : 0 ) ^ ( (n) & 0x02 ? CRC16_B##k##_1 : 0 ) ^ \
+                              ( (n) & 0x04 ? CRC16_B##k##_2 : 0 ) ^ ( (n) & 0x08 ? CRC16_B##k##_3 : 0 ) ^ \
+                              ( (n) & 0x10 ? CRC16_B##k##_4 : 0 ) ^ ( (n) & 0x20 ? CRC16_B##k##_5 : 0 ) ^ \
+                              ( (n) & 0x40 ? CRC16_B##k##_6 : 0 ) ^ ( (n) & 0x80 ? CRC16_B##k##_7 : 0 ) )
+#define CRC16_LOW( k, n )   ( CRC16_VALUE( k, n ) & 0xFF )
+#define CRC16_HIGH( k, n )  ( CRC16_VALUE( k, n ) >> 8 )
+#define CRC16_NIBBLE( k, n ) CRC16_S4( n )
 
-static uint8_t table_low[] = {
-    0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7, 0x05, 0xC5, 0xC4,
-    0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E, 0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09,
-    0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9, 0x1B, 0xDB, 0xDA, 0x1A, 0x1E, 0xDE, 0xDF, 0x1F, 0xDD,
-    0x1D, 0x1C, 0xDC, 0x14, 0xD4, 0xD5, 0x15, 0xD7, 0x17, 0x16, 0xD6, 0xD2, 0x12, 0x13, 0xD3,
-    0x11, 0xD1, 0xD0, 0x10, 0xF0, 0x30, 0x31, 0xF1, 0x33, 0xF3, 0xF2, 0x32, 0x36, 0xF6, 0xF7,
-    0x37, 0xF5, 0x35, 0x34, 0xF4, 0x3C, 0xFC, 0xFD, 0x3D, 0xFF, 0x3F, 0x3E, 0xFE, 0xFA, 0x3A,
-    0x3B, 0xFB, 0x39, 0xF9, 0xF8, 0x38, 0x28, 0xE8, 0xE9, 0x29, 0xEB, 0x2B, 0x2A, 0xEA, 0xEE,
-    0x2E, 0x2F, 0xEF, 0x2D, 0xED, 0xEC, 0x2C, 0xE4, 0x24, 0x25, 0xE5, 0x27, 0xE7, 0xE6, 0x26,
-    0x22, 0xE2, 0xE3, 0x23, 0xE1, 0x21, 0x20, 0xE0, 0xA0, 0x60, 0x61, 0xA1, 0x63, 0xA3, 0xA2,
-    0x62, 0x66, 0xA6, 0xA7, 0x67, 0xA5, 0x65, 0x64, 0xA4, 0x6C, 0xAC, 0xAD, 0x6D, 0xAF, 0x6F,
-    0x6E, 0xAE, 0xAA, 0x6A, 0x6B, 0xAB, 0x69, 0xA9, 0xA8, 0x68, 0x78, 0xB8, 0xB9, 0x79, 0xBB,
-    0x7B, 0x7A, 0xBA, 0xBE, 0x7E, 0x7F, 0xBF, 0x7D, 0xBD, 0xBC, 0x7C, 0xB4, 0x74, 0x75, 0xB5,
-    0x77, 0xB7, 0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71, 0x70, 0xB0, 0x50, 0x90, 0x91,
-    0x51, 0x93, 0x53, 0x52, 0x92, 0x96, 0x56, 0x57, 0x97, 0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C,
-    0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E, 0x5A, 0x9A, 0x9B, 0x5B, 0x99, 0x59, 0x58, 0x98, 0x88,
-    0x48, 0x49, 0x89, 0x4B, 0x8B, 0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D, 0x4C, 0x8C,
-    0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83, 0x41, 0x81, 0x80,
-    0x40
+//список значений f( k, n ) для n = 0 - 15 и n = 0 - 255
+#define CRC16_ROW4( f, k, n )   f( k, (n) ), f( k, (n) + 1 ), f( k, (n) + 2 ), f( k, (n) + 3 )
+#define CRC16_ROW16( f, k, n )  CRC16_ROW4( f, k, (n) ), CRC16_ROW4( f, k, (n) + 4 ), \
+                                CRC16_ROW4( f, k, (n) + 8 ), CRC16_ROW4( f, k, (n) + 12 )
+#define CRC16_ROW64( f, k, n )  CRC16_ROW16( f, k, (n) ), CRC16_ROW16( f, k, (n) + 16 ), \
+                                CRC16_ROW16( f, k, (n) + 32 ), CRC16_ROW16( f, k, (n) + 48 )
+#define CRC16_TABLE( f, k )     CRC16_ROW64( f, k, 0 ), CRC16_ROW64( f, k, 64 ), \
+                                CRC16_ROW64( f, k, 128 ), CRC16_ROW64( f, k, 192 )
+
+#if CRC16_ENGINE == CRC16_ENGINE_BYTE
+//младший и старший байты КС раздельно (таблицы протокола MODBUS, в описании протокола 
+//таблица младших байтов названа auchCRCHi, старших - auchCRCLo)
+static const uint8_t table_low[256] = { CRC16_TABLE( CRC16_LOW, 0 ) };
+static const uint8_t table_high[256] = { CRC16_TABLE( CRC16_HIGH, 0 ) };
+#elif CRC16_ENGINE == CRC16_ENGINE_WORD
+static const uint16_t table_word[256] = { CRC16_TABLE( CRC16_VALUE, 0 ) };
+#elif CRC16_ENGINE == CRC16_ENGINE_SLICE4
+//таблица k - КС байта, за которым следуют k нулевых байт
+static const uint16_t table_slice[4][256] = {
+    { CRC16_TABLE( CRC16_VALUE, 0 ) },
+    { CRC16_TABLE( CRC16_VALUE, 1 ) },
+    { CRC16_TABLE( CRC16_VALUE, 2 ) },
+    { CRC16_TABLE( CRC16_VALUE, 3 ) }
    };
+#elif CRC16_ENGINE == CRC16_ENGINE_NIBBLE
+static const uint16_t table_nibble[16] = { CRC16_ROW16( CRC16_NIBBLE, 0, 0 ) };
+#else
+#error "CRC16_ENGINE: unknown CRC16 engine"
+#endif
+
+//****************************************************************************************************************
+// Локальные прототипы функций
+//****************************************************************************************************************
+static uint16_t CRC16Byte( uint16_t crc, uint8_t byte );
 
 //****************************************************************************************************************
 // Расчет контрольной суммы
@@ -60,13 +92,122 @@ static uint8_t table_low[] = {
 //****************************************************************************************************************
 uint16_t CalcCRC16( uint8_t *buf, uint16_t len ) {
 
-    uint16_t index;
-    uint8_t high = 0xFF, low = 0xFF;
+    uint16_t crc = 0xFFFF;
     
-    while ( len-- ) {
-        index = low ^ *buf++;
-        low = high ^ table_high[index];
-        high = table_low[index];
+#if CRC16_ENGINE == CRC16_ENGINE_SLICE4
+    //по 4 байта: регистр КС с первыми двумя байтами сдвигается на 4 байта, 
+    //третий байт - на 2 байта, четвертый - на 1 байт
+    while ( len >= 4 ) {
+        crc ^= buf[0] | ( buf[1] << 8 );
+        crc = table_slice[3][crc & 0xFF] ^ table_slice[2][crc >> 8] ^ table_slice[1][buf[2]] ^ table_slice[0][buf[3]];
+        buf += 4;
+        len -= 4;
+       }
+#endif
+    while ( len-- )
+        crc = CRC16Byte( crc, *buf++ );
+    return crc;
+ }
+
+//****************************************************************************************************************
+// Расчет КС с очередным байтом данных
+// uint16_t crc - текущее значение КС
+// uint8_t byte - байт данных
+// return       - контрольная сумма
+//****************************************************************************************************************
+static uint16_t CRC16Byte( uint16_t crc, uint8_t byte ) {
+
+#if CRC16_ENGINE == CRC16_ENGINE_BYTE
+    uint8_t index;
+
+    index = ( crc & 0xFF ) ^ byte;
+    return ( table_high[index] << 8 ) | ( ( crc >> 8 ) ^ table_low[index] );
+#elif CRC16_ENGINE == CRC16_ENGINE_NIBBLE
+    crc ^= byte;
+    crc = ( crc >> 4 ) ^ table_nibble[crc & 0x0F];
+    return ( crc >> 4 ) ^ table_nibble[crc & 0x0F];
+#elif CRC16_ENGINE == CRC16_ENGINE_SLICE4
+    return ( crc >> 8 ) ^ table_slice[0][( crc ^ byte ) & 0xFF];
+#else
+    return ( crc >> 8 ) ^ table_word[( crc ^ byte ) & 0xFF];
+#endif
+ }
+
+//****************************************************************************************************************
+// Начало расчета КС принимаемого фрейма
+// CRC16_RUN *run - состояние расчета КС
+//****************************************************************************************************************
+void CRC16Start( CRC16_RUN *run ) {
+
+    run->crc = 0xFFFF;
+    run->cnt = 0;
+ }
+
+//****************************************************************************************************************
+// Добавление принятого байта в расчет КС, в КС включается байт, принятый на два байта раньше
+// CRC16_RUN *run - состояние расчета КС
+// uint8_t byte   - принятый байт
+//****************************************************************************************************************
+void CRC16Add( CRC16_RUN *run, uint8_t byte ) {
+
+    if ( run->cnt < 2 ) {
+        run->last[run->cnt++] = byte;
+        return;
        }
-    return high << 8 | low;
+    run->crc = CRC16Byte( run->crc, run->last[0] );
+    run->last[0] = run->last[1];
+    run->last[1] = byte;
+ }
+
+//****************************************************************************************************************
+// Проверка КС принятого фрейма: два последних байта фрейма (младший байт первым) совпадают
+// с КС предыдущих байтов
+// const CRC16_RUN *run - состояние расчета КС
+// return               - true - КС верная
+//****************************************************************************************************************
+bool CRC16Check( const CRC16_RUN *run ) {
+
+    return run->cnt == 2 && run->crc == ( run->last[0] | ( run->last[1] << 8 ) );
+ }
+
+//****************************************************************************************************************
+// Расчет таблицы сдвига разности КС на указанное кол-во байтов для CRC16Patch(): значение для бита i -
+// регистр КС с единичным битом i после расчета с нулевыми байтами. Вызов при инициализации.
+// uint16_t *shift - таблица сдвига, CRC16_SHIFT_SIZE значений
+// uint16_t len    - кол-во байтов сообщения после изменяемых байтов
+//****************************************************************************************************************
+void CRC16ShiftInit( uint16_t *shift, uint16_t len ) {
+
+    uint8_t bit;
+    uint16_t crc, cnt;
+
+    for ( bit = 0; bit < CRC16_SHIFT_SIZE; bit++ ) {
+        crc = 1 << bit;
+        for ( cnt = 0; cnt < len; cnt++ )
+            crc = CRC16Byte( crc, 0 );
+        shift[bit] = crc;
+       }
+ }
+
+//****************************************************************************************************************
+// Поправка КС сообщения при изменении байтов внутри сообщения без пересчета всего сообщения.
+// Расчет линейный: разность КС равна КС разности байтов (с нулевым начальным значением), 
+// сдвинутой на кол-во байтов после изменяемых байтов, см. CRC16ShiftInit()
+// uint16_t crc          - КС сообщения до изменения
+// const uint8_t *delta  - разность (XOR) прежних и новых значений изменяемых байтов
+// uint8_t len           - кол-во изменяемых байтов
+// const uint16_t *shift - таблица сдвига, см. CRC16ShiftInit()
+// return                - КС сообщения после изменения
+//****************************************************************************************************************
+uint16_t CRC16Patch( uint16_t crc, const uint8_t *delta, uint8_t len, const uint16_t *shift ) {
+
+    uint8_t bit;
+    uint16_t diff = 0;
+
+    while ( len-- )
+        diff = CRC16Byte( diff, *delta++ );
+    for ( bit = 0; diff; bit++, diff >>= 1 )
+        if ( diff & 0x01 )
+            crc ^= shift[bit];
+    return crc;
  }
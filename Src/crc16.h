@@ -5,7 +5,32 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+//варианты расчета КС, выбор варианта - определение CRC16_ENGINE в настройках проекта
+#define CRC16_ENGINE_BYTE       0           //две таблицы 256 x 8 бит (512 байт), расчет по байту
+#define CRC16_ENGINE_WORD       1           //таблица 256 x 16 бит (512 байт), расчет по байту
+#define CRC16_ENGINE_SLICE4     2           //четыре таблицы 256 x 16 бит (2 Кб), расчет по 4 байта
+#define CRC16_ENGINE_NIBBLE     3           //таблица 16 x 16 бит (32 байта), расчет по 4 бита
+
+#define CRC16_SHIFT_SIZE        16          //размер таблицы сдвига разности КС, см. CRC16ShiftInit()
+
+#if !defined( CRC16_ENGINE )
+#define CRC16_ENGINE            CRC16_ENGINE_BYTE
+#endif
+
+//КС фрейма, вычисляемая по мере приема байтов: два последних байта (КС фрейма) в расчет 
+//не включаются до приема следующего байта, проверка принятого фрейма - одно сравнение
+typedef struct {
+    uint16_t crc;                       //КС байтов фрейма, кроме двух последних
+    uint8_t  last[2];                   //два последних принятых байта
+    uint8_t  cnt;                       //кол-во байтов в last[]
+ } CRC16_RUN;
+
 uint16_t CalcCRC16( uint8_t *buf, uint16_t len );
+void CRC16Start( CRC16_RUN *run );
+void CRC16Add( CRC16_RUN *run, uint8_t byte );
+bool CRC16Check( const CRC16_RUN *run );
+void CRC16ShiftInit( uint16_t *shift, uint16_t len );
+uint16_t CRC16Patch( uint16_t crc, const uint8_t *delta, uint8_t len, const uint16_t *shift );
 
 #endif
 
@@ -3,18 +3,20 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "bcd.h"
 #include "crc16.h"
 #include "data.h"
 #include "main.h"
 #include "param.h"
+#include "xtime.h"
 #include "events.h"
 #include "mercury.h"
+#include "modbus.h"
 
 #include "cmsis_os.h"
 #include "stm32f1xx_hal.h"
 
 //macros convert little <-> big endian 
-#define SWAP16( val )          ( (((val) & 0xFF00) >> 8) | (((val) & 0x00FF) << 8) )
 #define SWAP32( val )          ( (((val) & 0xFF) << 24) | (((val) & 0xFF00) << 8) | (((val) & 0xFF0000) >> 8) | (((val) >> 24) & 0xFF) )
 
 //****************************************************************************************************************
@@ -27,6 +29,85 @@
 #define DATA_ANSWER_ERROR       3       //данные ответа не совпадают с типом запроса
 #define DATA_ECHO_ERROR         4       //нет эхо запроса данных
 
+#define MERC_REQUEST_PAUSE      20      //пауза между запросами к счетчику (ms)
+#define MERC_TIME_ANSWER        50      //максимальное время реакции счетчика на запрос (ms)
+#define MERC_BITS_BYTE          10      //кол-во бит при передаче одного байта (старт + 8 бит + стоп)
+
+#define POLL_BACKOFF_TIME       250     //начальная задержка повтора запроса при отсутствии ответа (ms)
+#define POLL_BACKOFF_MAX        6       //максимальная степень увеличения задержки (250 ms * 2^6 = 16 сек)
+#define POLL_RATE_INTERVAL      60000   //интервал расчета фактической частоты опроса (ms)
+#define POLL_CMND_NONE          0xFF    //нет команд готовых к отправке
+
+#define MERC_PROBE_FAIL         8       //кол-во неудачных запросов подряд до начала подбора скорости обмена
+#define MERC_PROBE_SPEED        4       //индекс максимальной проверяемой скорости (9600), 
+                                        //проверка выполняется от максимальной скорости к 600
+
+//Состояния приема ответа счетчика
+#define FRAME_ECHO              0       //прием эхо запроса
+#define FRAME_HEADER            1       //прием заголовка ответа (номер счетчика, код команды)
+#define FRAME_BODY              2       //прием данных ответа
+#define FRAME_CRC               3       //прием КС ответа
+#define FRAME_DONE              4       //ответ принят полностью
+
+//****************************************************************************************************************
+// Локальные типы данных
+//****************************************************************************************************************
+//описание команды опроса счетчика
+typedef struct {
+    uint8_t  command;                   //код команды
+    uint8_t  priority;                  //приоритет команды, 0 - высший
+    uint32_t period;                    //период опроса (ms), 0 - максимально часто
+    bool     midnight;                  //признак дополнительного опроса при смене суток
+ } POLL_CMND;
+
+//текущее состояние опроса команды
+typedef struct {
+    uint32_t time_next;                 //время отправки следующего запроса (ms)
+    uint8_t  backoff;                   //степень увеличения задержки повтора при отсутствии ответа
+    uint16_t cnt_valid;                 //кол-во успешных ответов в текущем интервале расчета частоты
+    uint16_t rate;                      //фактическая частота опроса (ответов в минуту)
+    uint32_t cnt_stat[LINK_STAT_CNT];   //накопленное кол-во запросов по результатам обмена, см. DATA_*
+ } POLL_STATE;
+
+//данные счетчика
+typedef struct {
+    uint32_t voltage;                   //напряжение сети
+    uint32_t current;                   //ток в нагрузке
+    uint32_t power;                     //мощность нагрузки
+    uint32_t tariff1;                   //накопленное значение, дневной тариф
+    uint32_t tariff2;                   //накопленное значение, ночной тариф
+    uint8_t  stat_link;                 //результат последнего обмена, см. DATA_*
+ } MERC_DATA;
+
+//редко изменяемые атрибуты счетчика, сохраняются после первого успешного чтения
+typedef struct {
+    uint8_t  valid;                     //маска прочитанных атрибутов, см. ATTR_*
+    uint8_t  version[3];                //версия ПО счетчика
+    uint32_t serial;                    //серийный номер
+    timedate date_prod;                 //дата выпуска
+    timedate last_on;                   //дата/время последнего включения
+    timedate last_off;                  //дата/время последнего выключения
+    timedate datetime;                  //дата/время часов счетчика на момент чтения
+ } MERC_ATTR;
+
+//состояние приема ответа счетчика
+typedef struct {
+    uint8_t state;                      //этап приема пакета, см. FRAME_*
+    uint8_t pos;                        //кол-во принятых байт текущего этапа
+    uint8_t parsed;                     //кол-во обработанных байт приемного буфера
+    uint8_t echo_end;                   //смещение первого байта после эхо запроса
+    uint8_t answer;                     //смещение заголовка ответа в приемном буфере
+    uint8_t data_len;                   //размер данных ответа по типу запроса
+    uint32_t time_done;                 //время приема последнего байта ответа (ms)
+ } MERC_FRAME;
+
+//описание ответа счетчика на команду
+typedef struct {
+    uint8_t command;                    //код команды
+    uint8_t data_len;                   //размер блока данных ответа (без заголовка и КС)
+    bool    bcd;                        //данные ответа в упакованном BCD формате
+ } MERC_ANSWER;
+
 //****************************************************************************************************************
 // Внешние переменные
 //****************************************************************************************************************
@@ -44,20 +125,77 @@ static char * const link_error[] = {
         " Ошибка  ответа ", 
         " Нет эхо запроса" 
       };
+//идентификаторы параметров номеров счетчиков
+static const uint8_t merc_numb[MERC_DEV_MAX] = { GLB_MERCURY_NUMB, GLB_MERCURY_NUMB2, GLB_MERCURY_NUMB3, GLB_MERCURY_NUMB4 };
 static uint8_t recv_data[64];
-static uint8_t stat_link = 0, next_cmnd = 0;
-static uint8_t list_cmnd[] = { INSTANTVAL, POWERTAR };      //список команд отправляемых счетчику
-static uint32_t voltage, current, power, tariff1, tariff2;
+static uint8_t poll_day = 0, poll_meter = 0;
+static uint32_t time_answer, time_rate;
+static uint8_t poll_fail;
+//список команд отправляемых счетчику
+static const POLL_CMND poll_cmnd[MERC_CMND_CNT] = {
+    { INSTANTVAL, 0, 0,        false }, //мгновенные значения - максимально часто
+    { POWERTAR,   1, 60000,    true  }, //значения тарифов - раз в минуту и в начале суток
+    { DATETIME,   2, 600000,   false }, //часы счетчика - раз в 10 минут
+    { LASTON,     2, 3600000,  false }, //последнее включение - раз в час
+    { LASTOFF,    2, 3600000,  false }, //последнее выключение - раз в час
+    { SERIALNUM,  3, 86400000, false }, //серийный номер - раз в сутки
+    { VERSION,    3, 86400000, false }, //версия ПО - раз в сутки
+    { DATEPROD,   3, 86400000, false }  //дата выпуска - раз в сутки
+ };
+#define POLL_CMND_CNT   MERC_CMND_CNT
+
+//размер и формат данных ответов счетчика по кодам команд
+static const MERC_ANSWER merc_answer[] = {
+    { INSTANTVAL, 7,  true  },          //U(2), I(2), P(3)
+    { POWERTAR,   16, true  },          //тарифы 1-4 по 4 байта
+    { DATETIME,   7,  true  },          //день недели, час, мин, сек, день, месяц, год
+    { LASTON,     7,  true  },          //день недели, час, мин, сек, день, месяц, год
+    { LASTOFF,    7,  true  },          //день недели, час, мин, сек, день, месяц, год
+    { SERIALNUM,  4,  false },          //серийный номер (двоичный)
+    { VERSION,    3,  false },          //версия ПО
+    { DATEPROD,   3,  true  }           //день, месяц, год
+ };
+
+static POLL_STATE poll_state[MERC_DEV_MAX][POLL_CMND_CNT];
+//гистограмма времени от начала запроса до приема последнего байта ответа, см. LatencyIndex()
+static uint32_t latency[MERC_DEV_MAX][LATENCY_CNT];
+static MERC_DATA merc_data[MERC_DEV_MAX];
+//опубликованные значения счетчиков: два буфера на счетчик, текущий буфер - младший бит номера обновления
+static MERC_VALUES merc_value[MERC_DEV_MAX][2];
+static volatile uint32_t value_seq[MERC_DEV_MAX];
+static MERC_ATTR merc_attr[MERC_DEV_MAX];
+//история мгновенных значений: кольцевой буфер, выборка с номером seq хранится в hist[seq % HIST_SIZE]
+static HIST_SAMPLE hist[HIST_SIZE];
+static volatile uint32_t hist_seq;      //номер последней выборки
+static uint32_t hist_time[MERC_DEV_MAX];//время последней выборки счетчика (сек), см. HistAdd()
+static volatile MERC_FRAME frame;
+static CRC16_RUN frame_crc;             //КС ответа, рассчитывается с заголовка ответа при разборе
 
 //****************************************************************************************************************
 // Прототипы локальные функций
 //****************************************************************************************************************
-static void RequestData( uint8_t command );
+static void RequestData( uint8_t meter, uint8_t command );
 static void ThreadRequest( void const *arg );
-static uint8_t DataCheck( uint8_t );
+static uint8_t DataCheck( uint8_t meter );
 static uint8_t RecvCnt( void );
 static void ClearRecvBuff( void );
-static uint32_t BCDToInt( uint8_t *ptr, uint8_t cnt_byte );
+static void FrameParse( uint8_t byte );
+static const MERC_ANSWER *AnswerFind( uint8_t command );
+static uint8_t AnswerLen( uint8_t command );
+static void DecodeAttr( uint8_t meter, uint8_t command, uint8_t *ptr );
+static void DecodeTime( uint8_t *ptr, timedate *tm );
+static uint32_t CalcTimeAnswer( uint32_t speed );
+static void SpeedSet( uint8_t index );
+static bool SpeedProbe( void );
+static void PollRestart( void );
+static uint8_t RequestWait( uint8_t meter, uint8_t command );
+static uint8_t PollNext( uint8_t *meter, uint32_t *delay );
+static void PollUpdate( uint8_t meter, uint8_t index, uint8_t stat );
+static uint8_t LatencyIndex( uint32_t time );
+static void DataPublish( uint8_t meter, uint8_t command );
+static uint16_t ValueAge( uint32_t now, uint32_t time, bool valid );
+static void HistAdd( uint8_t meter, const MERC_VALUES *value );
+static uint16_t HistLimit( uint32_t value );
 
 osThreadDef( ThreadRequest, osPriorityNormal, 1, 0 ); 
 
@@ -66,23 +204,191 @@ osThreadDef( ThreadRequest, osPriorityNormal, 1, 0 );
 //****************************************************************************************************************
 void InitData( void ) {
 
-    voltage = current = power = tariff1 = tariff2 = 0;
+    memset( merc_data, 0x00, sizeof( merc_data ) );
+    memset( merc_value, 0x00, sizeof( merc_value ) );
+    memset( (void *)value_seq, 0x00, sizeof( value_seq ) );
+    memset( merc_attr, 0x00, sizeof( merc_attr ) );
     memset( recv_data, 0x00, sizeof( recv_data ) ); 
+    memset( poll_state, 0x00, sizeof( poll_state ) );
+    memset( latency, 0x00, sizeof( latency ) );
+    memset( hist, 0x00, sizeof( hist ) );
+    hist_seq = 0;
+    time_answer = CalcTimeAnswer( GlbParamGet( GLB_MERCURY_SPEED, GLB_PARAM_VALUE ) );
+    //при включении подбор скорости обмена начинается после первого неудачного запроса
+    poll_fail = MERC_PROBE_FAIL - 1;
     HAL_UART_Receive_IT( &huart2, recv_data, sizeof( recv_data ) );
+    //прерывание по паузе на линии RX - признак завершения приема пакета
+    __HAL_UART_ENABLE_IT( &huart2, UART_IT_IDLE );
     tid_ThreadReq = osThreadCreate( osThread( ThreadRequest ), NULL );
  }
 
 //****************************************************************************************************************
-// Проверка на переполнение буфера данных
+// Расчет максимального времени ожидания ответа счетчика для скорости обмена
+// uint32_t speed - скорость обмена
+// return         - время ожидания (ms)
+//****************************************************************************************************************
+static uint32_t CalcTimeAnswer( uint32_t speed ) {
+
+    if ( !speed )
+        return MERC_TIME_ANSWER;
+    //время передачи эхо запроса + самого длинного ответа + время реакции счетчика
+    return ( ( sizeof( MERC_REQUEST ) + sizeof( MERC_TARIFF ) ) * MERC_BITS_BYTE * 1000 + speed - 1 ) / speed + MERC_TIME_ANSWER;
+ }
+
+//****************************************************************************************************************
+// Переинициализация порта обмена со счетчиком на новую скорость
+// uint8_t index - индекс (код) скорости, см. GlbValueIndex()
+//****************************************************************************************************************
+static void SpeedSet( uint8_t index ) {
+
+    HAL_UART_DeInit( &huart2 );
+    huart2.Init.BaudRate = GlbValueIndex( index );
+    HAL_UART_Init( &huart2 );
+    time_answer = CalcTimeAnswer( huart2.Init.BaudRate );
+    //прием данных и прерывание по паузе на линии RX
+    HAL_UART_Receive_IT( &huart2, recv_data, sizeof( recv_data ) );
+    __HAL_UART_ENABLE_IT( &huart2, UART_IT_IDLE );
+ }
+
+//****************************************************************************************************************
+// Подбор скорости обмена со счетчиками
+// Скорости проверяются от MERC_PROBE_SPEED до 600, выбирается первая (максимальная) скорость на
+// которой получен ответ с правильной КС от любого из счетчиков, найденная скорость сохраняется
+// в параметрах. Если ответ не получен ни на одной скорости - восстанавливается скорость из параметров.
+// return = true  - скорость подобрана
+//          false - счетчики не отвечают
+//****************************************************************************************************************
+static bool SpeedProbe( void ) {
+
+    int8_t index;
+    uint8_t meter;
+
+    for ( index = MERC_PROBE_SPEED; index >= 0; index-- ) {
+        SpeedSet( index );
+        for ( meter = 0; meter < GlbParamGet( GLB_MERCURY_CNT, GLB_PARAM_VALUE ); meter++ ) {
+            osDelay( MERC_REQUEST_PAUSE );
+            if ( RequestWait( meter, INSTANTVAL ) != DATA_ANSWER_VALID )
+                continue;
+            //скорость найдена
+            if ( index != GlbParamGet( GLB_MERCURY_SPEED, GLB_PARAM_INDEX ) )
+                GlbParamSave( GLB_MERCURY_SPEED, index );
+            PollRestart();
+            return true;
+           }
+       }
+    SpeedSet( GlbParamGet( GLB_MERCURY_SPEED, GLB_PARAM_INDEX ) );
+    return false;
+ }
+
+//****************************************************************************************************************
+// Возобновление опроса всех команд всех счетчиков без задержки
+//****************************************************************************************************************
+static void PollRestart( void ) {
+
+    uint8_t dev, idx;
+
+    for ( dev = 0; dev < MERC_DEV_MAX; dev++ ) {
+        for ( idx = 0; idx < POLL_CMND_CNT; idx++ ) {
+            poll_state[dev][idx].time_next = HAL_GetTick();
+            poll_state[dev][idx].backoff = 0;
+           }
+       }
+ }
+
+//****************************************************************************************************************
+// Применение скорости обмена со счетчиком, измененной в параметрах (ModBus, клавиатура)
+// Порт переинициализируется потоком обмена со счетчиком между запросами, см. ThreadRequest()
+//****************************************************************************************************************
+void DataSpeedChange( void ) {
+
+    osSignalSet( tid_ThreadReq, EVN_MERC_SPEED );
+ }
+
+//****************************************************************************************************************
+// Разбор принятых байт ответа счетчика, контроль паузы на линии RX, проверка на переполнение буфера данных
 // Вызов из stm32f1xx_it.c (USART2_IRQHandler)
 //****************************************************************************************************************
 void DataRecv( void ) {
 
-    //проверка на переполнения буфера
-    if ( RecvCnt() > sizeof( recv_data ) - 2 )
+    uint8_t cnt;
+
+    //разбор новых байт в приемном буфере
+    cnt = RecvCnt();
+    while ( frame.parsed < cnt && frame.state != FRAME_DONE )
+        FrameParse( recv_data[frame.parsed] );
+    //пауза на линии после приема байта, сообщим потоку о приеме пакета
+    if ( __HAL_UART_GET_FLAG( &huart2, UART_FLAG_IDLE ) ) {
+        __HAL_UART_CLEAR_IDLEFLAG( &huart2 );
+        osSignalSet( tid_ThreadReq, EVN_MERC_RECV );
+       }
+    //проверка на переполнения буфера, принятый ответ сохраняем до проверки
+    if ( RecvCnt() > sizeof( recv_data ) - 2 && frame.state != FRAME_DONE )
         ClearRecvBuff();
  } 
 
+//****************************************************************************************************************
+// Пошаговый разбор ответа счетчика: эхо запроса, заголовок ответа, данные ответа, КС
+// Байты не совпадающие с ожидаемыми эхо и заголовком (помехи на линии) пропускаются,
+// размер данных ответа определяется по типу запроса, см. merc_answer[]
+// КС ответа рассчитывается по мере приема, расчет начинается заново с каждого начала заголовка
+// uint8_t byte - очередной принятый байт
+//****************************************************************************************************************
+static void FrameParse( uint8_t byte ) {
+
+    uint8_t *ptr;
+
+    ptr = (uint8_t *)&req;
+    if ( frame.state == FRAME_ECHO ) {
+        //эхо запроса полностью совпадает с запросом
+        if ( byte == ptr[frame.pos] ) {
+            if ( ++frame.pos >= sizeof( req ) ) {
+                frame.state = FRAME_HEADER;
+                frame.echo_end = frame.parsed + 1;
+                frame.pos = 0;
+               }
+           }
+        else frame.pos = ( byte == ptr[0] ) ? 1 : 0;
+       }
+    else if ( frame.state == FRAME_HEADER ) {
+        //заголовок ответа совпадает с началом запроса: номер счетчика, код команды
+        if ( byte == ptr[frame.pos] ) {
+            if ( !frame.pos ) {
+                frame.answer = frame.parsed;
+                CRC16Start( &frame_crc );
+               }
+            CRC16Add( &frame_crc, byte );
+            if ( ++frame.pos >= sizeof( MERC_HEADER ) ) {
+                frame.state = frame.data_len ? FRAME_BODY : FRAME_CRC;
+                frame.pos = 0;
+               }
+           }
+        else if ( byte == ptr[0] ) {
+            frame.answer = frame.parsed;
+            frame.pos = 1;
+            CRC16Start( &frame_crc );
+            CRC16Add( &frame_crc, byte );
+           }
+        else frame.pos = 0;
+       }
+    else if ( frame.state == FRAME_BODY ) {
+        CRC16Add( &frame_crc, byte );
+        if ( ++frame.pos >= frame.data_len ) {
+            frame.state = FRAME_CRC;
+            frame.pos = 0;
+           }
+       }
+    else if ( frame.state == FRAME_CRC ) {
+        CRC16Add( &frame_crc, byte );
+        if ( ++frame.pos >= 2 ) {
+            //ответ принят, сообщим потоку
+            frame.state = FRAME_DONE;
+            frame.time_done = HAL_GetTick();
+            osSignalSet( tid_ThreadReq, EVN_MERC_RECV );
+           }
+       }
+    frame.parsed++;
+ }
+
 //**********************************************************************************
 // Кол-во принятых байт по UART2
 //**********************************************************************************
@@ -92,13 +398,20 @@ static uint8_t RecvCnt( void ) {
  }
 
 //**********************************************************************************
-// Чистим приемный буфер
+// Чистим приемный буфер, прием перезапускается с начала буфера
+// Байты, принятые после полного ответа (помехи, запоздавшее эхо), могут заполнить
+// буфер, после чего HAL завершает прием и отключает прерывание RXNE, поэтому прием
+// не продолжается изменением указателей, а запускается заново
 //**********************************************************************************
 static void ClearRecvBuff( void ) {
 
+    HAL_UART_AbortReceive( &huart2 );
     memset( recv_data, 0x00, sizeof( recv_data ) );
-    huart2.RxXferCount = sizeof( recv_data );
-    huart2.pRxBuffPtr = (uint8_t*)recv_data;
+    //разбор продолжаем с начала буфера, начатый ответ не сохранился
+    frame.parsed = frame.pos = frame.echo_end = 0;
+    if ( frame.state > FRAME_HEADER )
+        frame.state = FRAME_HEADER;
+    HAL_UART_Receive_IT( &huart2, recv_data, sizeof( recv_data ) );
  }
 
 //****************************************************************************************************************
@@ -106,169 +419,739 @@ static void ClearRecvBuff( void ) {
 //****************************************************************************************************************
 static void ThreadRequest( void const *arg ) {
 
+    osEvent event;
+    uint8_t index, meter, stat;
+    uint32_t time_wait;
+
+    time_rate = HAL_GetTick();
     while ( true ) {
-        //ждем секундный сигнал от RTC для отправки запроса
-        osDelay( 500 ); //период запроса даных счетчика
-        ClearRecvBuff(); 
-        //отправка запроса счетчику
-        RequestData( list_cmnd[next_cmnd++] );
-        if ( next_cmnd >= sizeof( list_cmnd ) )
-            next_cmnd = 0; 
-        osDelay( 150 ); //ждем ответ счетчика
-        //проверка принятых данных
-        stat_link = DataCheck( RecvCnt() );
+        //пауза между запросами, скорость обмена изменена в параметрах - переинициализация порта
+        event = osSignalWait( EVN_MERC_SPEED, MERC_REQUEST_PAUSE );
+        if ( event.status == osEventSignal ) {
+            SpeedSet( GlbParamGet( GLB_MERCURY_SPEED, GLB_PARAM_INDEX ) );
+            PollRestart();
+            poll_fail = 0;
+            continue;
+           }
+        //выбор команды для отправки
+        index = PollNext( &meter, &time_wait );
+        if ( index == POLL_CMND_NONE ) {
+            //ждем наступления времени опроса ближайшей команды или изменения скорости обмена
+            event = osSignalWait( EVN_MERC_SPEED, time_wait );
+            if ( event.status == osEventSignal )
+                osSignalSet( tid_ThreadReq, EVN_MERC_SPEED );
+            continue;
+           }
+        stat = RequestWait( meter, poll_cmnd[index].command );
+        PollUpdate( meter, index, stat );
+        //контроль неудачных запросов подряд, отсутствие эхо - неисправность линии, 
+        //а не несовпадение скорости обмена
+        if ( stat == DATA_ANSWER_VALID || stat == DATA_ECHO_ERROR )
+            poll_fail = 0;
+        else if ( ++poll_fail >= MERC_PROBE_FAIL ) {
+            SpeedProbe();
+            poll_fail = 0;
+           }
+       }
+ }
+
+//****************************************************************************************************************
+// Отправка запроса счетчику, ожидание и проверка ответа, публикация значений счетчика
+// uint8_t meter   - индекс счетчика
+// uint8_t command - код команды запроса
+// return          - результат проверки ответа, см. DataCheck()
+//****************************************************************************************************************
+static uint8_t RequestWait( uint8_t meter, uint8_t command ) {
+
+    osEvent event;
+    uint8_t stat;
+    uint32_t time_start, time_wait;
+
+    ClearRecvBuff(); 
+    osSignalClear( tid_ThreadReq, EVN_MERC_RECV );
+    //отправка запроса счетчику
+    RequestData( meter, command );
+    //ждем завершения приема ответа счетчика или истечения времени ожидания
+    time_start = HAL_GetTick();
+    while ( ( time_wait = HAL_GetTick() - time_start ) < time_answer ) {
+        event = osSignalWait( EVN_MERC_RECV, time_answer - time_wait );
+        if ( event.status != osEventSignal )
+            break; //счетчик не ответил
+        if ( frame.state == FRAME_DONE )
+            break; //ответ принят полностью
        }
+    //время получения ответа
+    if ( frame.state == FRAME_DONE )
+        latency[meter][LatencyIndex( frame.time_done - time_start )]++;
+    //проверка принятых данных
+    stat = DataCheck( meter );
+    merc_data[meter].stat_link = stat;
+    DataPublish( meter, stat == DATA_ANSWER_VALID ? command : 0 );
+    ModbusImage( meter );
+    return stat;
+ }
+
+//****************************************************************************************************************
+// Публикация значений счетчика для чтения другими потоками
+// Значения записываются в свободный буфер, после чего номер обновления переключает текущий буфер,
+// поток читающий значения никогда не ожидает завершения записи, см. GetSnapshot()
+// uint8_t meter   - индекс счетчика
+// uint8_t command - код команды успешного запроса, обновляется время и признак наличия значений,
+//                   0 - значения не получены
+//****************************************************************************************************************
+static void DataPublish( uint8_t meter, uint8_t command ) {
+
+    uint32_t seq;
+    MERC_VALUES *value, *prev;
+
+    seq = value_seq[meter] + 1;
+    prev = &merc_value[meter][value_seq[meter] & 0x01];
+    value = &merc_value[meter][seq & 0x01];
+    value->seq = seq;
+    value->voltage = merc_data[meter].voltage;
+    value->current = merc_data[meter].current;
+    value->power = merc_data[meter].power;
+    value->tariff1 = merc_data[meter].tariff1;
+    value->tariff2 = merc_data[meter].tariff2;
+    value->stat_link = merc_data[meter].stat_link;
+    value->time_inst = prev->time_inst;
+    value->time_tariff = prev->time_tariff;
+    value->quality = prev->quality;
+    if ( command == INSTANTVAL ) {
+        value->time_inst = HAL_GetTick();
+        value->quality |= VALUE_INST_VALID;
+       }
+    if ( command == POWERTAR ) {
+        value->time_tariff = HAL_GetTick();
+        value->quality |= VALUE_TARIFF_VALID;
+       }
+    //значения записаны до переключения буфера
+    __DMB();
+    value_seq[meter] = seq;
+    if ( command == INSTANTVAL )
+        HistAdd( meter, value );
+ }
+
+//****************************************************************************************************************
+// Добавление выборки мгновенных значений в историю
+// Мгновенные значения опрашиваются несколько раз в секунду, в историю добавляется не более одной
+// выборки счетчика за секунду RTC. История HIST_SIZE выборок охватывает HIST_SIZE / кол-во счетчиков
+// секунд: 64 сек для одного счетчика, 32 сек для двух, 21 сек для трех, 16 сек для четырех.
+// Выборка помечается недействительной на время записи, поток читающий историю не ожидает 
+// завершения записи, см. HistRead()
+// uint8_t meter             - индекс счетчика
+// const MERC_VALUES *value  - опубликованные значения счетчика
+//****************************************************************************************************************
+static void HistAdd( uint8_t meter, const MERC_VALUES *value ) {
+
+    uint32_t seq, time;
+    HIST_SAMPLE *sample;
+
+    time = GetTimeSec();
+    if ( time == hist_time[meter] )
+        return;
+    hist_time[meter] = time;
+    seq = hist_seq + 1;
+    sample = &hist[seq % HIST_SIZE];
+    sample->seq = 0;
+    __DMB();
+    sample->time = time;
+    sample->meter = meter;
+    sample->quality = value->quality;
+    sample->voltage = HistLimit( value->voltage );
+    sample->current = HistLimit( value->current );
+    sample->power = HistLimit( value->power );
+    __DMB();
+    sample->seq = seq;
+    hist_seq = seq;
+ }
+
+//****************************************************************************************************************
+// Ограничение значения для выборки истории
+//****************************************************************************************************************
+static uint16_t HistLimit( uint32_t value ) {
+
+    return value > UINT16_MAX ? UINT16_MAX : value;
+ }
+
+//****************************************************************************************************************
+// Чтение выборок истории, номер которых больше указанного, в порядке возрастания номеров
+// Если выборки с указанного номера уже перезаписаны, чтение начинается с самой старой выборки
+// uint32_t seq        - номер последней полученной выборки, 0 - чтение с самой старой выборки
+// HIST_SAMPLE *sample - адрес для размещения выборок
+// uint8_t cnt         - максимальное кол-во выборок
+// return              - кол-во прочитанных выборок
+//****************************************************************************************************************
+uint8_t HistRead( uint32_t seq, HIST_SAMPLE *sample, uint8_t cnt ) {
+
+    uint8_t read = 0;
+    uint32_t first, last, check;
+    HIST_SAMPLE *ptr;
+
+    HistRange( &first, &last );
+    if ( seq < first )
+        seq = first - 1;
+    for ( seq++; seq <= last && read < cnt; seq++ ) {
+        //выборка копируется, если во время копирования она не была перезаписана
+        ptr = &hist[seq % HIST_SIZE];
+        check = ptr->seq;
+        __DMB();
+        memcpy( sample, ptr, sizeof( HIST_SAMPLE ) );
+        __DMB();
+        if ( check != seq || ptr->seq != seq )
+            continue;
+        sample++;
+        read++;
+       }
+    return read;
+ }
+
+//****************************************************************************************************************
+// Диапазон номеров выборок в истории
+// uint32_t *first - номер самой старой выборки
+// uint32_t *last  - номер последней выборки, 0 - история пустая
+//****************************************************************************************************************
+void HistRange( uint32_t *first, uint32_t *last ) {
+
+    *last = hist_seq;
+    *first = *last > HIST_SIZE ? *last - HIST_SIZE + 1 : 1;
+ }
+
+//****************************************************************************************************************
+// Выбор счетчика и команды для отправки
+// Счетчики опрашиваются по очереди, очередь переходит к следующему счетчику после каждого запроса,
+// счетчики без готовых к отправке команд (например при увеличенной задержке повтора) пропускаются.
+// Из команд счетчика, время опроса которых наступило, выбирается команда дольше всех ожидающая
+// отправки, при равном времени ожидания - команда с высшим приоритетом. Команда с нулевым периодом
+// опроса готова к отправке сразу после ответа, но не блокирует опрос остальных команд.
+// uint8_t *meter  - индекс выбранного счетчика
+// uint32_t *delay - время до наступления опроса ближайшей команды (ms), если нет готовых команд
+// return          - индекс команды в poll_cmnd[] или POLL_CMND_NONE
+//****************************************************************************************************************
+static uint8_t PollNext( uint8_t *meter, uint32_t *delay ) {
+
+    timedate tm;
+    int32_t remain;
+    POLL_STATE *state;
+    uint8_t idx, dev, cnt, dev_cnt, index = POLL_CMND_NONE;
+    uint32_t now;
+
+    now = HAL_GetTick();
+    dev_cnt = GlbParamGet( GLB_MERCURY_CNT, GLB_PARAM_VALUE );
+    //смена суток, внеочередной опрос отмеченных команд
+    GetTimeDate( &tm );
+    if ( tm.td_day != poll_day ) {
+        poll_day = tm.td_day;
+        for ( dev = 0; dev < dev_cnt; dev++ ) {
+            for ( idx = 0; idx < POLL_CMND_CNT; idx++ ) {
+                if ( poll_cmnd[idx].midnight == true )
+                    poll_state[dev][idx].time_next = now;
+               }
+           }
+       }
+    *delay = POLL_BACKOFF_TIME;
+    if ( poll_meter >= dev_cnt )
+        poll_meter = 0;
+    for ( cnt = 0, dev = poll_meter; cnt < dev_cnt; cnt++ ) {
+        state = poll_state[dev];
+        for ( idx = 0; idx < POLL_CMND_CNT; idx++ ) {
+            remain = (int32_t)( state[idx].time_next - now );
+            if ( remain > 0 ) {
+                //время опроса не наступило
+                if ( (uint32_t)remain < *delay )
+                    *delay = remain;
+                continue;
+               }
+            if ( index == POLL_CMND_NONE || (int32_t)( state[idx].time_next - state[index].time_next ) < 0 || 
+               ( state[idx].time_next == state[index].time_next && poll_cmnd[idx].priority < poll_cmnd[index].priority ) )
+                index = idx;
+           }
+        if ( index != POLL_CMND_NONE ) {
+            //следующий запрос - к следующему счетчику
+            *meter = dev;
+            poll_meter = dev + 1;
+            return index;
+           }
+        if ( ++dev >= dev_cnt )
+            dev = 0;
+       }
+    return POLL_CMND_NONE;
+ }
+
+//****************************************************************************************************************
+// Расчет времени следующего опроса команды по результату обмена, расчет фактической частоты опроса
+// При отсутствии ответа задержка повтора запроса увеличивается в 2 раза до POLL_BACKOFF_MAX
+// uint8_t meter - индекс счетчика
+// uint8_t index - индекс команды в poll_cmnd[]
+// uint8_t stat  - результат проверки ответа, см. DATA_*
+//****************************************************************************************************************
+static void PollUpdate( uint8_t meter, uint8_t index, uint8_t stat ) {
+
+    uint8_t idx, dev;
+    uint32_t now, delay;
+    POLL_STATE *state;
+
+    now = HAL_GetTick();
+    state = &poll_state[meter][index];
+    if ( stat == DATA_NO_ANSWER || stat == DATA_ECHO_ERROR ) {
+        //счетчик не отвечает, увеличиваем задержку повтора
+        delay = (uint32_t)POLL_BACKOFF_TIME << state->backoff;
+        if ( delay < poll_cmnd[index].period )
+            delay = poll_cmnd[index].period;
+        if ( state->backoff < POLL_BACKOFF_MAX )
+            state->backoff++;
+       }
+    else {
+        delay = poll_cmnd[index].period;
+        state->backoff = 0;
+        if ( stat == DATA_ANSWER_VALID && state->cnt_valid < UINT16_MAX )
+            state->cnt_valid++;
+       }
+    if ( stat < LINK_STAT_CNT )
+        state->cnt_stat[stat]++;
+    state->time_next = now + delay;
+    //фактическая частота опроса команд
+    if ( now - time_rate < POLL_RATE_INTERVAL )
+        return;
+    time_rate = now;
+    for ( dev = 0; dev < MERC_DEV_MAX; dev++ ) {
+        for ( idx = 0; idx < POLL_CMND_CNT; idx++ ) {
+            poll_state[dev][idx].rate = poll_state[dev][idx].cnt_valid;
+            poll_state[dev][idx].cnt_valid = 0;
+           }
+       }
+ }
+
+//****************************************************************************************************************
+// Возвращает фактическую частоту опроса счетчика по коду команды
+// uint8_t meter   - индекс счетчика
+// uint8_t command - код команды, см. mercury.h
+// return          - кол-во успешных ответов в минуту
+//****************************************************************************************************************
+uint16_t GetPollRate( uint8_t meter, uint8_t command ) {
+
+    uint8_t idx;
+
+    if ( meter >= MERC_DEV_MAX )
+        return 0;
+    for ( idx = 0; idx < POLL_CMND_CNT; idx++ ) {
+        if ( poll_cmnd[idx].command == command )
+            return poll_state[meter][idx].rate;
+       }
+    return 0;
+ }
+
+//****************************************************************************************************************
+// Возвращает накопленное кол-во запросов к счетчику по результату обмена
+// uint8_t meter - индекс счетчика
+// uint8_t index - индекс команды (0 - MERC_CMND_CNT-1), порядок команд см. poll_cmnd[]
+// uint8_t stat  - результат обмена (0 - LINK_STAT_CNT-1): успешно, нет ответа, ошибка КС, 
+//                 ошибка ответа, нет эхо запроса
+// return        - кол-во запросов
+//****************************************************************************************************************
+uint32_t GetLinkCount( uint8_t meter, uint8_t index, uint8_t stat ) {
+
+    if ( meter >= MERC_DEV_MAX || index >= POLL_CMND_CNT || stat >= LINK_STAT_CNT )
+        return 0;
+    return poll_state[meter][index].cnt_stat[stat];
+ }
+
+//****************************************************************************************************************
+// Возвращает накопленное кол-во запросов к счетчику по результату обмена для всех команд
+// uint8_t meter - индекс счетчика
+// uint8_t stat  - результат обмена (0 - LINK_STAT_CNT-1)
+// return        - кол-во запросов
+//****************************************************************************************************************
+uint32_t GetLinkTotal( uint8_t meter, uint8_t stat ) {
+
+    uint8_t idx;
+    uint32_t total = 0;
+
+    for ( idx = 0; idx < POLL_CMND_CNT; idx++ )
+        total += GetLinkCount( meter, idx, stat );
+    return total;
+ }
+
+//****************************************************************************************************************
+// Возвращает значение гистограммы времени получения ответа счетчика
+// uint8_t meter  - индекс счетчика
+// uint8_t bucket - интервал гистограммы (0 - LATENCY_CNT-1): 0 - менее 1 ms, 
+//                  N - от 2^(N-1) до 2^N-1 ms, последний интервал - все большие значения
+// return         - кол-во ответов
+//****************************************************************************************************************
+uint32_t GetLatency( uint8_t meter, uint8_t bucket ) {
+
+    if ( meter >= MERC_DEV_MAX || bucket >= LATENCY_CNT )
+        return 0;
+    return latency[meter][bucket];
+ }
+
+//****************************************************************************************************************
+// Сброс накопленной статистики обмена со счетчиками
+//****************************************************************************************************************
+void LinkStatReset( void ) {
+
+    uint8_t dev, idx;
+
+    for ( dev = 0; dev < MERC_DEV_MAX; dev++ ) {
+        for ( idx = 0; idx < POLL_CMND_CNT; idx++ )
+            memset( poll_state[dev][idx].cnt_stat, 0x00, sizeof( poll_state[dev][idx].cnt_stat ) );
+       }
+    memset( latency, 0x00, sizeof( latency ) );
+ }
+
+//****************************************************************************************************************
+// Возвращает индекс интервала гистограммы времени получения ответа (логарифмическая шкала)
+// uint32_t time - время (ms)
+// return        - индекс интервала 0 - LATENCY_CNT-1
+//****************************************************************************************************************
+static uint8_t LatencyIndex( uint32_t time ) {
+
+    uint8_t index = 0;
+
+    while ( time && index < LATENCY_CNT - 1 ) {
+        time >>= 1;
+        index++;
+       }
+    return index;
  }
 
 //****************************************************************************************************************
 // Формирование пакета с запросом данных от счетчика
+// uint8_t meter   - индекс счетчика
 // uint8_t command - код команды запроса
 //****************************************************************************************************************
-static void RequestData( uint8_t command ) {
+static void RequestData( uint8_t meter, uint8_t command ) {
 
     uint8_t *ptr;
     uint32_t numb_dev;
 
     ptr = (uint8_t *)&req;
     //номер счетчика
-    numb_dev = GlbParamGet( GLB_MERCURY_NUMB, GLB_PARAM_VALUE );
+    numb_dev = GlbParamGet( merc_numb[meter], GLB_PARAM_VALUE );
     req.num_dev = SWAP32( numb_dev );
     req.command = command;
     //контрольная сумма
     req.crc = CalcCRC16( ptr, sizeof( req ) - 2 );
+    //начало разбора ответа
+    frame.data_len = AnswerLen( command );
+    frame.parsed = frame.pos = frame.echo_end = frame.answer = 0;
+    frame.state = FRAME_ECHO;
     HAL_UART_Transmit_IT( &huart2, ptr, sizeof( req ) );
     
  }
 
 //****************************************************************************************************************
-// Проверка принятых пакетов данных от счетчика
-// uint8_t data_len           - размер блока данных с ответом
+// Проверка ответа счетчика по результату разбора принятых байт, см. FrameParse()
+// Значения декодируются непосредственно из приемного буфера, при ошибке ответа сохраняются
+// последние достоверные значения, их возраст контролируется по времени получения, см. GetSnapshot()
+// uint8_t meter              - индекс счетчика
 // return = DATA_ANSWER_VALID - данные получены и проверены
 //          DATA_NO_ANSWER    - счетчик не отвечает
 //          DATA_CRC_ERROR    - ошибка принятых данных
+//          DATA_ANSWER_ERROR - данные ответа не совпадают с типом запроса
+//          DATA_ECHO_ERROR   - нет эхо запроса
 //****************************************************************************************************************
-static uint8_t DataCheck( uint8_t data_len ) {
+static uint8_t DataCheck( uint8_t meter ) {
 
-    uint16_t crc;
-    uint32_t *ptr;
-    uint8_t check, temp;
-    MERC_TARIFF tariff;
-    MERC_INST_VAL inst_val;
+    uint8_t len, *value;
+    MERC_DATA *data;
 
-    if ( !data_len )
+    data = &merc_data[meter];
+    if ( frame.state == FRAME_ECHO )
         return DATA_ECHO_ERROR;
-    if ( data_len == sizeof( req ) )
-        return DATA_NO_ANSWER;
-    //определим тип принятого пакета данных
-    if ( data_len == sizeof( inst_val ) ) {
-        //мгновенные значения ток, напряжение, мощность
-        memcpy( &inst_val, recv_data, sizeof( inst_val ) );
-        //проверим КС только по данным ответа
-        check = 0;
-        crc = CalcCRC16( ((uint8_t *)&inst_val) + sizeof( req ), sizeof( inst_val ) - 2 - sizeof( req ) );
-        if ( inst_val.num_dev == req.num_dev )
-            check++;
-        if ( inst_val.command2 == req.command )
-            check++;
-        if ( crc != inst_val.crc_answer ) {
-            voltage = current = power = 0;
-            return DATA_CRC_ERROR;
-           }
-        if ( check == 2 ) {
-            //счетчик возвращает значения 0x23 0x76 (упакованный BCD формат)
-            //например: 0x23 0x76 = 237.6V, значение в памяти: 0x23 0x76, значение в переменной 0x7623
-            //значение после перестановки 0x2376
-            temp = inst_val.power[0];
-            inst_val.power[0] = inst_val.power[2];
-            inst_val.power[2] = temp;
-            inst_val.voltage = SWAP16( inst_val.voltage );
-            inst_val.current = SWAP16( inst_val.current );
-            voltage = BCDToInt( (uint8_t *)&inst_val.voltage, sizeof( inst_val.voltage ) );
-            current = BCDToInt( (uint8_t *)&inst_val.current, sizeof( inst_val.current ) );
-            power = BCDToInt( (uint8_t *)&inst_val.power, sizeof( inst_val.power ) );
-            return DATA_ANSWER_VALID;
-           }
-        voltage = current = power = 0;
-        //данные ответа не совпадают с типом запроса
+    if ( frame.state == FRAME_HEADER ) {
+        if ( RecvCnt() <= frame.echo_end )
+            return DATA_NO_ANSWER;
+        //после эхо приняты данные, но заголовок не совпадает с запросом
         return DATA_ANSWER_ERROR;
        }
-
-    if ( data_len == sizeof( tariff ) ) {
-        //значения расхода по тарифам
-        check = 0;
-        memcpy( &tariff, recv_data, sizeof( tariff ) );
-        //проверим КС только по данным ответа
-        crc = CalcCRC16( ((uint8_t *)&tariff) + sizeof( req ), sizeof( tariff ) - 2 - sizeof( req ) );
-        if ( tariff.num_dev == req.num_dev )
-            check++;
-        if ( tariff.command2 == req.command )
-            check++;
-        if ( crc != tariff.crc_answer ) {
-            tariff1 = tariff2 = 0;
-            return DATA_CRC_ERROR;
-           }
-        if ( check == 2 ) {
-            //необходимо переставить байты местами.
-            tariff.tariff1 = SWAP32( tariff.tariff1 );
-            tariff.tariff2 = SWAP32( tariff.tariff2 );
-            tariff1 = BCDToInt( (uint8_t *)&tariff.tariff1, sizeof( tariff.tariff1 ) );
-            tariff2 = BCDToInt( (uint8_t *)&tariff.tariff2, sizeof( tariff.tariff2 ) );
-            return DATA_ANSWER_VALID;
-           }
-        tariff1 = tariff2 = 0;
-        //данные ответа не совпадают с типом запроса
+    if ( frame.state != FRAME_DONE ) {
+        //ответ принят не полностью
         return DATA_ANSWER_ERROR;
        }
-    //данные ответа не соответствуют запросу
-    return DATA_ANSWER_ERROR;
+    //КС только по данным ответа рассчитана при разборе, см. FrameParse()
+    if ( !CRC16Check( &frame_crc ) )
+        return DATA_CRC_ERROR;
+    len = frame.data_len;
+    value = recv_data + frame.answer + sizeof( MERC_HEADER );
+    //проверка BCD значений, недопустимые тетрады - искажение данных не выявленное КС
+    if ( AnswerFind( req.command )->bcd && !BCDCheck( value, len ) ) {
+        return DATA_ANSWER_ERROR;
+       }
+    if ( req.command == INSTANTVAL ) {
+        //мгновенные значения напряжение, ток, мощность, счетчик возвращает значения 
+        //в упакованном BCD формате старшим байтом вперед: 0x23 0x76 = 237.6V
+        data->voltage = BCDToInt( value, 2 );
+        data->current = BCDToInt( value + 2, 2 );
+        data->power = BCDToInt( value + 4, 3 );
+        return DATA_ANSWER_VALID;
+       }
+    if ( req.command == POWERTAR ) {
+        //значения расхода по тарифам, 4 байта на тариф
+        data->tariff1 = BCDToInt( value, 4 );
+        data->tariff2 = BCDToInt( value + 4, 4 );
+        return DATA_ANSWER_VALID;
+       }
+    //атрибуты счетчика
+    DecodeAttr( meter, req.command, value );
+    return DATA_ANSWER_VALID;
+ }
+
+//****************************************************************************************************************
+// Возвращает описание ответа счетчика по коду команды
+// uint8_t command - код команды
+// return          - указатель на описание ответа, NULL - команда не поддерживается
+//****************************************************************************************************************
+static const MERC_ANSWER *AnswerFind( uint8_t command ) {
+
+    uint8_t idx;
+
+    for ( idx = 0; idx < sizeof( merc_answer ) / sizeof( MERC_ANSWER ); idx++ ) {
+        if ( merc_answer[idx].command == command )
+            return &merc_answer[idx];
+       }
+    return NULL;
+ }
+
+//****************************************************************************************************************
+// Возвращает размер блока данных ответа счетчика по коду команды
+// uint8_t command - код команды
+// return          - размер данных ответа, 0 - команда не поддерживается
+//****************************************************************************************************************
+static uint8_t AnswerLen( uint8_t command ) {
+
+    const MERC_ANSWER *answer;
+
+    answer = AnswerFind( command );
+    if ( answer == NULL )
+        return 0;
+    return answer->data_len;
+ }
+
+//****************************************************************************************************************
+// Сохранение атрибутов счетчика из данных ответа
+// uint8_t meter   - индекс счетчика
+// uint8_t command - код команды запроса
+// uint8_t *ptr    - указатель на данные ответа (после заголовка)
+//****************************************************************************************************************
+static void DecodeAttr( uint8_t meter, uint8_t command, uint8_t *ptr ) {
+
+    MERC_ATTR *attr;
+
+    attr = &merc_attr[meter];
+    if ( command == VERSION ) {
+        memcpy( attr->version, ptr, sizeof( attr->version ) );
+        attr->valid |= ATTR_VERSION;
+       }
+    if ( command == SERIALNUM ) {
+        //серийный номер передается старшим байтом вперед
+        attr->serial = ( (uint32_t)ptr[0] << 24 ) | ( (uint32_t)ptr[1] << 16 ) | ( (uint32_t)ptr[2] << 8 ) | ptr[3];
+        attr->valid |= ATTR_SERIALNUM;
+       }
+    if ( command == DATEPROD ) {
+        //день, месяц, год (BCD)
+        memset( &attr->date_prod, 0x00, sizeof( attr->date_prod ) );
+        attr->date_prod.td_day = BCDToInt( ptr, 1 );
+        attr->date_prod.td_month = BCDToInt( ptr + 1, 1 );
+        attr->date_prod.td_year = 2000 + BCDToInt( ptr + 2, 1 );
+        attr->valid |= ATTR_DATEPROD;
+       }
+    if ( command == LASTON ) {
+        DecodeTime( ptr, &attr->last_on );
+        attr->valid |= ATTR_LASTON;
+       }
+    if ( command == LASTOFF ) {
+        DecodeTime( ptr, &attr->last_off );
+        attr->valid |= ATTR_LASTOFF;
+       }
+    if ( command == DATETIME ) {
+        DecodeTime( ptr, &attr->datetime );
+        attr->valid |= ATTR_DATETIME;
+       }
+ }
+
+//****************************************************************************************************************
+// Преобразование дата/время счетчика: день недели, час, мин, сек, день, месяц, год (BCD)
+// uint8_t *ptr - указатель на данные ответа
+// timedate *tm - структура для размещения значений
+//****************************************************************************************************************
+static void DecodeTime( uint8_t *ptr, timedate *tm ) {
+
+    tm->td_dow = BCDToInt( ptr, 1 );
+    tm->td_hour = BCDToInt( ptr + 1, 1 );
+    tm->td_min = BCDToInt( ptr + 2, 1 );
+    tm->td_sec = BCDToInt( ptr + 3, 1 );
+    tm->td_day = BCDToInt( ptr + 4, 1 );
+    tm->td_month = BCDToInt( ptr + 5, 1 );
+    tm->td_year = 2000 + BCDToInt( ptr + 6, 1 );
+ }
+
+//****************************************************************************************************************
+// Возвращает маску прочитанных атрибутов счетчика
+// uint8_t meter - индекс счетчика
+// return        - маска атрибутов, см. ATTR_*
+//****************************************************************************************************************
+uint8_t GetAttrValid( uint8_t meter ) {
+
+    if ( meter >= MERC_DEV_MAX )
+        return 0;
+    return merc_attr[meter].valid;
+ }
+
+//****************************************************************************************************************
+// Возвращает числовое значение атрибута счетчика
+// uint8_t meter - индекс счетчика
+// uint8_t attr  - код атрибута: ATTR_VERSION, ATTR_SERIALNUM
+// return        - ATTR_VERSION: 3 байта версии ПО (0x00VVVVVV), ATTR_SERIALNUM: серийный номер
+//****************************************************************************************************************
+uint32_t GetAttr( uint8_t meter, uint8_t attr ) {
+
+    MERC_ATTR *ptr;
+
+    if ( meter >= MERC_DEV_MAX )
+        return 0;
+    ptr = &merc_attr[meter];
+    if ( attr == ATTR_VERSION )
+        return ( (uint32_t)ptr->version[0] << 16 ) | ( (uint32_t)ptr->version[1] << 8 ) | ptr->version[2];
+    if ( attr == ATTR_SERIALNUM )
+        return ptr->serial;
+    return 0;
+ }
+
+//****************************************************************************************************************
+// Возвращает значение дата/время атрибута счетчика
+// uint8_t meter - индекс счетчика
+// uint8_t attr  - код атрибута: ATTR_DATEPROD, ATTR_LASTON, ATTR_LASTOFF, ATTR_DATETIME
+// timedate *tm  - структура для размещения значения
+// return = true - значение атрибута прочитано из счетчика
+//****************************************************************************************************************
+bool GetAttrTime( uint8_t meter, uint8_t attr, timedate *tm ) {
+
+    memset( tm, 0x00, sizeof( timedate ) );
+    if ( meter >= MERC_DEV_MAX )
+        return false;
+    if ( attr == ATTR_DATEPROD )
+        *tm = merc_attr[meter].date_prod;
+    if ( attr == ATTR_LASTON )
+        *tm = merc_attr[meter].last_on;
+    if ( attr == ATTR_LASTOFF )
+        *tm = merc_attr[meter].last_off;
+    if ( attr == ATTR_DATETIME )
+        *tm = merc_attr[meter].datetime;
+    return ( merc_attr[meter].valid & attr ) ? true : false;
+ }
+
+//****************************************************************************************************************
+// Внеочередное чтение значения из счетчика
+// uint8_t meter   - индекс счетчика
+// uint8_t command - код команды, см. mercury.h
+//****************************************************************************************************************
+void DataRefresh( uint8_t meter, uint8_t command ) {
+
+    uint8_t idx;
+
+    if ( meter >= MERC_DEV_MAX )
+        return;
+    for ( idx = 0; idx < POLL_CMND_CNT; idx++ ) {
+        if ( poll_cmnd[idx].command == command )
+            poll_state[meter][idx].time_next = HAL_GetTick();
+       }
  }
 
 //****************************************************************************************************************
 // Возвращает значения показаний счетчика
-// uint8_t data - код типа данных, см. INSTVAL_*
-// return       - значение показаний
+// uint8_t meter - индекс счетчика
+// uint8_t data  - код типа данных, см. INSTVAL_*
+// return        - значение показаний
 //****************************************************************************************************************
-uint32_t GetData( uint8_t data ) {
+uint32_t GetData( uint8_t meter, uint8_t data ) {
 
+    MERC_VALUES values;
+
+    GetSnapshot( meter, &values );
     if ( data == INSTVAL_VOLTAGE )
-        return voltage;
+        return values.voltage;
     if ( data == INSTVAL_CURRENT )
-        return current; 
+        return values.current; 
     if ( data == INSTVAL_POWER )
-        return power;
+        return values.power;
     if ( data == INSTVAL_TARIFF1 )
-        return tariff1;
+        return values.tariff1;
     if ( data == INSTVAL_TARIFF2 )
-        return tariff2;
+        return values.tariff2;
     return 0;
  }
 
 //****************************************************************************************************************
-// Преобразует значения в упакованном BCD формате в челое число (аналог функции atoi())
-// uint8_t *ptr     - указатель на первый (младший байт) числа
-// uint8_t cnt_byte - кол-во байт для преобразования
-// return           - преобразованное число
+// Копия всех значений счетчика полученных в одном цикле опроса
+// Возраст значений рассчитывается на момент вызова, значения старше GLB_VALUE_AGE 
+// или не полученные после включения отмечаются как недостоверные
+// uint8_t meter       - индекс счетчика
+// MERC_VALUES *values - указатель на структуру для размещения значений
 //****************************************************************************************************************
-static uint32_t BCDToInt( uint8_t *ptr, uint8_t cnt_byte ) {
+void GetSnapshot( uint8_t meter, MERC_VALUES *values ) {
+
+    uint32_t seq, now, age_max;
 
-    uint8_t i, low, high;
-    uint32_t dec = 1, result = 0;
-  
-    for ( i = 0; i < cnt_byte; i++, ptr++ ) {
-        low = ( (*ptr) & 0x0F );
-        result += low * dec;
-        dec *= 10;
-        high = ( ( (*ptr) & 0xF0 ) >> 4 );
-        result += high * dec;
-        dec *= 10;
+    if ( meter >= MERC_DEV_MAX ) {
+        memset( values, 0x00, sizeof( MERC_VALUES ) );
+        return;
        }
-    return result;
+    //копирование повторяется, если во время копирования поток опроса начал запись в этот же буфер
+    do {
+        seq = value_seq[meter];
+        __DMB();
+        memcpy( values, &merc_value[meter][seq & 0x01], sizeof( MERC_VALUES ) );
+        __DMB();
+       } while ( seq != value_seq[meter] );
+    //возраст и достоверность значений
+    now = HAL_GetTick();
+    age_max = GlbParamGet( GLB_VALUE_AGE, GLB_PARAM_VALUE );
+    values->age_inst = ValueAge( now, values->time_inst, values->quality & VALUE_INST_VALID );
+    values->age_tariff = ValueAge( now, values->time_tariff, values->quality & VALUE_TARIFF_VALID );
+    if ( values->age_inst > age_max )
+        values->quality &= ~VALUE_INST_VALID;
+    if ( values->age_tariff > age_max )
+        values->quality &= ~VALUE_TARIFF_VALID;
+ }
+
+//****************************************************************************************************************
+// Расчет возраста значений счетчика
+// uint32_t now  - текущее время (ms)
+// uint32_t time - время получения значений (ms)
+// bool valid    - значения были получены
+// return        - возраст значений (сек), VALUE_AGE_NONE - значения не получены
+//****************************************************************************************************************
+static uint16_t ValueAge( uint32_t now, uint32_t time, bool valid ) {
+
+    uint32_t age;
+
+    if ( !valid )
+        return VALUE_AGE_NONE;
+    age = ( now - time ) / 1000;
+    return ( age < VALUE_AGE_NONE ) ? age : VALUE_AGE_NONE;
  }
 
 //****************************************************************************************************************
 // Возвращает текстовую расшифровку состояние связи со счетчиком
+// uint8_t meter - индекс счетчика
+//****************************************************************************************************************
+char *GetStatus( uint8_t meter ) {
+
+    if ( meter >= MERC_DEV_MAX )
+        meter = 0;
+    return link_error[merc_data[meter].stat_link];
+ }
+
+//****************************************************************************************************************
+// Возвращает код состояния связи со счетчиком
+// uint8_t meter - индекс счетчика
+// return        - результат последнего обмена: 0 - данные получены и проверены, 1...4 - код ошибки
 //****************************************************************************************************************
-char *GetStatus( void ) {
+uint8_t GetLinkStat( uint8_t meter ) {
 
-    return link_error[stat_link];
+    if ( meter >= MERC_DEV_MAX )
+        return 0;
+    return merc_data[meter].stat_link;
  }
@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "xtime.h"
+
 //Коды чтения мгновенных значений
 #define INSTVAL_VOLTAGE         1       //напряжение сети (V)
 #define INSTVAL_CURRENT         2       //ток в нагрузке (A)
@@ -12,10 +14,73 @@
 #define INSTVAL_TARIFF1         4       //накопленное значение мощности, дневной тариф (kWh)
 #define INSTVAL_TARIFF2         5       //накопленное значение мощности, дневной тариф (kWh)
 
+//Маски атрибутов счетчика
+#define ATTR_VERSION            0x01    //версия ПО счетчика
+#define ATTR_SERIALNUM          0x02    //серийный номер
+#define ATTR_DATEPROD           0x04    //дата выпуска
+#define ATTR_LASTON             0x08    //дата/время последнего включения
+#define ATTR_LASTOFF            0x10    //дата/время последнего выключения
+#define ATTR_DATETIME           0x20    //дата/время часов счетчика
+
+//Статистика обмена со счетчиками
+#define MERC_CMND_CNT           8       //кол-во команд опроса счетчика
+#define LINK_STAT_CNT           5       //кол-во вариантов результата обмена
+#define LATENCY_CNT             12      //кол-во интервалов гистограммы времени ответа
+
+//Признаки достоверности значений счетчика
+#define VALUE_INST_VALID        0x01    //мгновенные значения U, I, P
+#define VALUE_TARIFF_VALID      0x02    //значения тарифов
+#define VALUE_AGE_NONE          0xFFFF  //значения не получены
+
+//История мгновенных значений счетчиков
+#define HIST_SIZE               64      //кол-во выборок в истории (все счетчики, не более одной выборки счетчика в сек)
+
+//Выборка мгновенных значений счетчика
+typedef struct {
+    uint32_t seq;                       //номер выборки (общий для всех счетчиков), 0 - нет выборки
+    uint32_t time;                      //время получения значений (сек от 01.01.1970)
+    uint8_t  meter;                     //индекс счетчика
+    uint8_t  quality;                   //признаки достоверности значений, см. VALUE_*
+    uint16_t voltage;                   //напряжение сети (0.1 V)
+    uint16_t current;                   //ток в нагрузке (0.01 A)
+    uint16_t power;                     //мощность нагрузки (W)
+ } HIST_SAMPLE;
+
+//Значения счетчика полученные в одном цикле опроса
+//При ошибках обмена сохраняются последние достоверные значения
+typedef struct {
+    uint32_t seq;                       //номер обновления значений
+    uint32_t time_inst;                 //время получения мгновенных значений (ms)
+    uint32_t time_tariff;               //время получения значений тарифов (ms)
+    uint16_t age_inst;                  //возраст мгновенных значений (сек), см. VALUE_AGE_NONE
+    uint16_t age_tariff;                //возраст значений тарифов (сек)
+    uint8_t  quality;                   //признаки достоверности значений, см. VALUE_*
+    uint32_t voltage;                   //напряжение сети (V)
+    uint32_t current;                   //ток в нагрузке (A)
+    uint32_t power;                     //мощность нагрузки (P)
+    uint32_t tariff1;                   //накопленное значение мощности, дневной тариф (kWh)
+    uint32_t tariff2;                   //накопленное значение мощности, ночной тариф (kWh)
+    uint8_t  stat_link;                 //результат последнего обмена
+ } MERC_VALUES;
+
 void InitData( void );
 void DataRecv( void );
-char *GetStatus( void );
-uint32_t GetData( uint8_t data );
+char *GetStatus( uint8_t meter );
+uint8_t GetLinkStat( uint8_t meter );
+uint32_t GetData( uint8_t meter, uint8_t data );
+void GetSnapshot( uint8_t meter, MERC_VALUES *values );
+uint16_t GetPollRate( uint8_t meter, uint8_t command );
+uint8_t GetAttrValid( uint8_t meter );
+uint32_t GetAttr( uint8_t meter, uint8_t attr );
+bool GetAttrTime( uint8_t meter, uint8_t attr, timedate *tm );
+void DataRefresh( uint8_t meter, uint8_t command );
+void DataSpeedChange( void );
+uint32_t GetLinkCount( uint8_t meter, uint8_t index, uint8_t stat );
+uint32_t GetLinkTotal( uint8_t meter, uint8_t stat );
+uint32_t GetLatency( uint8_t meter, uint8_t bucket );
+void LinkStatReset( void );
+uint8_t HistRead( uint32_t seq, HIST_SAMPLE *sample, uint8_t cnt );
+void HistRange( uint32_t *first, uint32_t *last );
 
 #endif
 
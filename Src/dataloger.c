@@ -1,6 +1,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "sd.h"
@@ -16,6 +17,29 @@
 #include "cmsis_os.h"
 #include "stm32f1xx_hal.h"
 
+//****************************************************************************************************************
+// Локальные константы
+//****************************************************************************************************************
+#define LOG_PATH_SIZE           64          //размер буфера имени файла
+#define LOG_SECTOR_SIZE         512         //размер сектора карты, размер буфера записей
+#define LOG_DAT_TITLE           "Date;Time;Voltage;Current;Power;Age;Valid\r\n" //заголовки колонок CSV файла текущих данных
+
+//****************************************************************************************************************
+// Локальные типы данных
+//****************************************************************************************************************
+//файл текущих данных счетчика, открыт до смены даты или остановки логирования
+//записи накапливаются в буфере до границы сектора файла, в файл записываются целые сектора
+typedef struct {
+    FIL file;
+    uint32_t date;                          //дата файла YYYYMMDD, 0 - файл закрыт
+    uint8_t  format;                        //формат файла, см. LOG_FORMAT_*
+    uint32_t time;                          //время первой записи, не сохраненной на карте (ms)
+    bool     pending;                       //есть записи, не сохраненные на карте
+    uint16_t len;                           //кол-во байт в буфере
+    uint16_t size;                          //размер буфера до границы сектора файла
+    char     buff[LOG_SECTOR_SIZE];         //буфер записей
+ } LOG_FILE;
+
 //****************************************************************************************************************
 // Внешние переменные
 //****************************************************************************************************************
@@ -27,12 +51,22 @@ extern bool sd_mount;
 uint8_t log_time;
 uint16_t err_mkdir = 0, err_file = 0;
 osThreadId tid_ThreadLog, tid_ThreadLogTimer; 
+static LOG_FILE dat_log[MERC_DEV_MAX];      //открытые файлы текущих данных счетчиков
+static uint32_t stat_data, stat_flush;      //статистика записи, см. DataLogerStat()
 
 //****************************************************************************************************************
 // Локальные прототипы функций потоков и таймеров
 //****************************************************************************************************************
 static void ThreadLog( void const *arg );
 static void ThreadLogTimer( void const *arg );
+static void LogDirName( char *path, timedate *tm );
+static void LogFileName( char *path, bool daily, char *name, uint8_t meter, char *ext, timedate *tm );
+static bool DatOpen( uint8_t meter, uint8_t format, timedate *tm );
+static bool DatWrite( uint8_t meter, const void *data, uint16_t len );
+static void DatRecord( LOG_BIN_RECORD *rec, MERC_VALUES *values, timedate *tm );
+static bool DatFlush( uint8_t meter );
+static void DatClose( uint8_t meter );
+static void DatSync( void );
 
 osThreadDef( ThreadLog, osPriorityNormal, 1, 2048 );
 osThreadDef( ThreadLogTimer, osPriorityNormal, 1, 0 );
@@ -53,19 +87,22 @@ void DataLogerInit( void ) {
 static void ThreadLogTimer( void const *arg ) {
 
     timedate tm;
+    bool active = false, ready;
     
     while ( true ) {
         //ждем сигнала от RTC
         osSignalWait( EVN_SEC_TIMER, osWaitForever );
-        //проверка включения режима логирования
-        if ( !GlbParamGet( GLB_DATA_LOG, GLB_PARAM_VALUE ) )
-            continue;
-        //проверка наличия SD карты
-        if ( HAL_GPIO_ReadPin( MMC_INS_GPIO_Port, MMC_INS_Pin ) )
-            continue;
-        //проверка монтирования SD карты
-        if ( sd_mount == false )
+        //проверка включения режима логирования, наличия и монтирования SD карты
+        ready = GlbParamGet( GLB_DATA_LOG, GLB_PARAM_VALUE ) && !HAL_GPIO_ReadPin( MMC_INS_GPIO_Port, MMC_INS_Pin ) && 
+                sd_mount == true;
+        if ( ready == false ) {
+            //логирование остановлено, открытые файлы данных закрываем
+            if ( active == true )
+                osSignalSet( tid_ThreadLog, EVN_LOG_CLOSE );
+            active = false;
             continue;
+           }
+        active = true;
         //текущее время
         GetTimeDate( &tm );
         if ( !tm.td_hour && !tm.td_min && !tm.td_sec )
@@ -80,8 +117,13 @@ static void ThreadLogTimer( void const *arg ) {
  }
  
 //****************************************************************************************************************
-// Сохраняет текущее значения данных (V,I,P) в файле: YYYYMM\YYYYMMDD_dat.csv
+// Сохраняет текущее значения данных (V,I,P) в файле: YYYYMM\YYYYMMDD_dat.csv или YYYYMM\YYYYMMDD_dat.bin
+// в зависимости от параметра GLB_LOG_FORMAT
+// Файлы текущих данных остаются открытыми до смены даты или остановки логирования, записи накапливаются
+// в буферах и записываются целыми секторами, не записанные данные сохраняются на карту не позднее 
+// GLB_LOG_SYNC сек после добавления, см. DatWrite(), DatSync()
 // Сохраняет текущее значение тарифов день/ночь в файлах: YYYYMM\YYYYMMDD_tar.csv и YYYY_tar.csv
+// Для каждого счетчика на линии ведутся отдельные файлы, см. LogFileName()
 // Для данного потока выделим индивидуальный размер стека, предварительно настроим RTX_Conf_CM.с, параметры:
 // Number of threads with user-provided stack size (Defines the number of threads with user-provided stack size.)
 // Определяет количество потоков с предоставленным пользователем размером стека.
@@ -92,75 +134,307 @@ static void ThreadLogTimer( void const *arg ) {
 static void ThreadLog( void const *arg ) {
 
     FIL dat_file;
+    timedate tm;
     osEvent event;
+    MERC_VALUES values;
+    LOG_BIN_RECORD record;
+    bool result;
+    uint8_t meter, meter_cnt, format;
     FRESULT file_result, dir_result;
-    char path[64], str[64];
+    char path[LOG_PATH_SIZE], str[64];
     
     while ( true ) {
         //бесконечно ждем любое нажатие клавиши
         event = osSignalWait( EVN_LOG_ANY, osWaitForever );
         if ( event.status == osEventSignal ) {
+            meter_cnt = GlbParamGet( GLB_MERCURY_CNT, GLB_PARAM_VALUE );
             //проверим маску сигнала
+            if ( event.value.signals & EVN_LOG_CLOSE ) {
+                //логирование остановлено, сохраним данные и закроем файлы
+                for ( meter = 0; meter < MERC_DEV_MAX; meter++ )
+                    DatClose( meter );
+               }
             if ( event.value.signals & EVN_LOG_DATA ) {
                 //сохраняем текущие данные
-                memset( path, 0x00, sizeof( path ) );
-                strcat( path, GetDateYM() );
-                dir_result = f_mkdir( path );
-                if ( !( dir_result == FR_OK || dir_result == FR_EXIST ) )
-                    err_mkdir++;
-                strcat( path, "/" );
-                strcat( path, GetDateYMD() );
-                strcat( path, "_dat.csv" );
-                file_result = f_open( &dat_file, path, FA_OPEN_ALWAYS | FA_WRITE );
-                if ( file_result == FR_OK ) {
-                    f_lseek( &dat_file, dat_file.fsize );
-                    if ( !dat_file.fsize )
-                        f_puts( "Date;Time;Voltage;Current;Power\r\n", &dat_file );
-                    sprintf( str, "%s;%.1f;%.2f;%u\r\n", GetDateTimeStr(), (float)GetData( INSTVAL_VOLTAGE )/10, (float)GetData( INSTVAL_CURRENT )/100, GetData( INSTVAL_POWER ) );
-                    f_puts( str, &dat_file );
-                    f_close( &dat_file );
+                format = GlbParamGet( GLB_LOG_FORMAT, GLB_PARAM_VALUE );
+                GetTimeDate( &tm );
+                for ( meter = 0; meter < meter_cnt; meter++ ) {
+                    GetSnapshot( meter, &values );
+                    if ( DatOpen( meter, format, &tm ) == false ) {
+                        err_file++;
+                        continue;
+                       }
+                    if ( format == LOG_FORMAT_BIN ) {
+                        DatRecord( &record, &values, &tm );
+                        result = DatWrite( meter, &record, sizeof( record ) );
+                       }
+                    else {
+                        sprintf( str, "%02u.%02u.%04u;%02u:%02u:%02u;%.1f;%.2f;%u;%u;%u\r\n", tm.td_day, tm.td_month, tm.td_year, 
+                                 tm.td_hour, tm.td_min, tm.td_sec, (float)values.voltage/10, (float)values.current/100, values.power,
+                                 values.age_inst, ( values.quality & VALUE_INST_VALID ) ? 1 : 0 );
+                        result = DatWrite( meter, str, strlen( str ) );
+                       }
+                    if ( result == false ) {
+                        err_file++;
+                        DatClose( meter );
+                       }
                    }
-                else err_file++;
+                //файлы счетчиков, исключенных из опроса
+                for ( ; meter < MERC_DEV_MAX; meter++ )
+                    DatClose( meter );
+                DatSync();
                }
             if ( event.value.signals & EVN_LOG_TARIFF ) {
-                //сохраняем тарифные данные в ежедневном файле
-                memset( path, 0x00, sizeof( path ) );
-                strcat( path, GetDateYM() );
+                //каталог и имена файлов по дате записи, см. LogFileName()
+                GetTimeDate( &tm );
+                LogDirName( path, &tm );
                 dir_result = f_mkdir( path );
                 if ( !( dir_result == FR_OK || dir_result == FR_EXIST ) )
                     err_mkdir++;
-                strcat( path, "/" );
-                strcat( path, GetDateYMD() );
-                strcat( path, "_tar.csv" );
-                file_result = f_open( &dat_file, path, FA_OPEN_ALWAYS | FA_WRITE );
-                if ( file_result == FR_OK ) {
-                    f_lseek( &dat_file, dat_file.fsize );
-                    if ( !dat_file.fsize )
-                        f_puts( "Date;Time;Tariff1;Tariff2\r\n", &dat_file );
-                    sprintf( str, "%s;%u;%u\r\n", GetDateTimeStr(), GetData( INSTVAL_TARIFF1 ), GetData( INSTVAL_TARIFF2 ) );
-                    f_puts( str, &dat_file );
-                    f_close( &dat_file );
-                   }
-                else err_file++;
-                //сохраняем тарифные данные в годовом файле
-                memset( path, 0x00, sizeof( path ) );
-                strcat( path, GetDateY() );
-                strcat( path, "_tar.csv" );
-                file_result = f_open( &dat_file, path, FA_OPEN_ALWAYS | FA_WRITE );
-                if ( file_result == FR_OK ) {
-                    f_lseek( &dat_file, dat_file.fsize );
-                    if ( !dat_file.fsize )
-                        f_puts( "Date;Time;Tariff1;Tariff2\r\n", &dat_file );
-                    sprintf( str, "%s;%u;%u\r\n", GetDateTimeStr(), GetData( INSTVAL_TARIFF1 ), GetData( INSTVAL_TARIFF2 ) );
-                    f_puts( str, &dat_file );
-                    f_close( &dat_file );
+                for ( meter = 0; meter < meter_cnt; meter++ ) {
+                    GetSnapshot( meter, &values );
+                    //сохраняем тарифные данные в ежедневном файле
+                    LogFileName( path, true, "_tar", meter, ".csv", &tm );
+                    file_result = f_open( &dat_file, path, FA_OPEN_ALWAYS | FA_WRITE );
+                    if ( file_result == FR_OK ) {
+                        f_lseek( &dat_file, dat_file.fsize );
+                        if ( !dat_file.fsize )
+                            f_puts( "Date;Time;Tariff1;Tariff2;Age;Valid\r\n", &dat_file );
+                        sprintf( str, "%s;%u;%u;%u;%u\r\n", GetDateTimeStr(), values.tariff1, values.tariff2, values.age_tariff, ( values.quality & VALUE_TARIFF_VALID ) ? 1 : 0 );
+                        f_puts( str, &dat_file );
+                        f_close( &dat_file );
+                       }
+                    else err_file++;
+                    //сохраняем тарифные данные в годовом файле
+                    LogFileName( path, false, "_tar", meter, ".csv", &tm );
+                    file_result = f_open( &dat_file, path, FA_OPEN_ALWAYS | FA_WRITE );
+                    if ( file_result == FR_OK ) {
+                        f_lseek( &dat_file, dat_file.fsize );
+                        if ( !dat_file.fsize )
+                            f_puts( "Date;Time;Tariff1;Tariff2;Age;Valid\r\n", &dat_file );
+                        sprintf( str, "%s;%u;%u;%u;%u\r\n", GetDateTimeStr(), values.tariff1, values.tariff2, values.age_tariff, ( values.quality & VALUE_TARIFF_VALID ) ? 1 : 0 );
+                        f_puts( str, &dat_file );
+                        f_close( &dat_file );
+                       }
+                    else err_file++;
                    }
-                else err_file++;
                }
           }
       }
  }
 
+//****************************************************************************************************************
+// Открывает файл текущих данных счетчика за текущую дату
+// При смене даты или формата файл закрывается, файл новой даты (формата) открывается для добавления записей
+// В новый файл записывается строка заголовков колонок (CSV) или заголовок LOG_BIN_HEADER (двоичный формат)
+// uint8_t meter   - индекс счетчика
+// uint8_t format  - формат файла, см. LOG_FORMAT_*
+// timedate *tm    - текущие дата/время
+// return          - true - файл открыт
+//****************************************************************************************************************
+static bool DatOpen( uint8_t meter, uint8_t format, timedate *tm ) {
+
+    bool result;
+    uint32_t date;
+    LOG_FILE *log;
+    FRESULT dir_result;
+    LOG_BIN_HEADER header;
+    char path[LOG_PATH_SIZE];
+
+    log = &dat_log[meter];
+    date = tm->td_year * 10000UL + tm->td_month * 100 + tm->td_day;
+    if ( log->date == date && log->format == format )
+        return true;
+    DatClose( meter );
+    //каталог и имя файла по дате записи: дата в имени файла совпадает с датой заголовка
+    LogDirName( path, tm );
+    dir_result = f_mkdir( path );
+    if ( !( dir_result == FR_OK || dir_result == FR_EXIST ) )
+        err_mkdir++;
+    LogFileName( path, true, "_dat", meter, format == LOG_FORMAT_BIN ? ".bin" : ".csv", tm );
+    if ( f_open( &log->file, path, FA_OPEN_ALWAYS | FA_WRITE ) != FR_OK )
+        return false;
+    f_lseek( &log->file, log->file.fsize );
+    log->date = date;
+    log->format = format;
+    log->pending = false;
+    log->len = 0;
+    //первая запись в буфер дополняет последний сектор файла
+    log->size = LOG_SECTOR_SIZE - log->file.fptr % LOG_SECTOR_SIZE;
+    if ( log->file.fsize )
+        return true;
+    if ( format == LOG_FORMAT_BIN ) {
+        memcpy( header.magic, LOG_BIN_MAGIC, sizeof( header.magic ) );
+        header.version = LOG_BIN_VERSION;
+        header.hdr_size = sizeof( LOG_BIN_HEADER );
+        header.rec_size = sizeof( LOG_BIN_RECORD );
+        header.meter = meter;
+        header.year = tm->td_year;
+        header.month = tm->td_month;
+        header.day = tm->td_day;
+        header.number = GlbParamGet( meter ? GLB_MERCURY_NUMB2 + meter - 1 : GLB_MERCURY_NUMB, GLB_PARAM_VALUE );
+        result = DatWrite( meter, &header, sizeof( header ) );
+       }
+    else result = DatWrite( meter, LOG_DAT_TITLE, sizeof( LOG_DAT_TITLE ) - 1 );
+    if ( result == false ) {
+        DatClose( meter );
+        return false;
+       }
+    return true;
+ }
+
+//****************************************************************************************************************
+// Добавляет запись в буфер файла текущих данных, заполненный до границы сектора буфер записывается в файл
+// uint8_t meter    - индекс счетчика
+// const void *data - запись
+// uint16_t len     - размер записи (байт)
+// return           - true - запись выполнена, false - ошибка записи в файл
+//****************************************************************************************************************
+static bool DatWrite( uint8_t meter, const void *data, uint16_t len ) {
+
+    LOG_FILE *log;
+    uint16_t part;
+    const uint8_t *src = data;
+
+    log = &dat_log[meter];
+    stat_data += len;
+    if ( log->pending == false ) {
+        log->pending = true;
+        log->time = HAL_GetTick();
+       }
+    while ( len ) {
+        part = log->size - log->len;
+        if ( part > len )
+            part = len;
+        memcpy( log->buff + log->len, src, part );
+        log->len += part;
+        src += part;
+        len -= part;
+        if ( log->len == log->size && DatFlush( meter ) == false )
+            return false;
+       }
+    return true;
+ }
+
+//****************************************************************************************************************
+// Формирует запись двоичного файла текущих данных, см. LOG_BIN_RECORD
+// LOG_BIN_RECORD *rec - буфер записи
+// MERC_VALUES *values - значения счетчика
+// timedate *tm        - текущие дата/время
+//****************************************************************************************************************
+static void DatRecord( LOG_BIN_RECORD *rec, MERC_VALUES *values, timedate *tm ) {
+
+    rec->time = tm->td_hour * 3600UL + tm->td_min * 60 + tm->td_sec;
+    if ( values->quality & VALUE_INST_VALID )
+        rec->time |= LOG_BIN_VALID;
+    rec->voltage = values->voltage;
+    rec->current = values->current;
+    rec->power = values->power > UINT16_MAX ? UINT16_MAX : values->power;
+    rec->age = values->age_inst;
+ }
+
+//****************************************************************************************************************
+// Записывает буфер записей в файл: целый сектор или часть сектора при сохранении/закрытии файла
+// Следующая запись в буфер дополняет сектор файла до границы
+// uint8_t meter - индекс счетчика
+// return        - true - запись выполнена
+//****************************************************************************************************************
+static bool DatFlush( uint8_t meter ) {
+
+    UINT written;
+    LOG_FILE *log;
+    FRESULT result;
+
+    log = &dat_log[meter];
+    if ( !log->len )
+        return true;
+    result = f_write( &log->file, log->buff, log->len, &written );
+    stat_flush++;
+    if ( result != FR_OK || written != log->len )
+        return false;
+    log->len = 0;
+    log->size = LOG_SECTOR_SIZE - log->file.fptr % LOG_SECTOR_SIZE;
+    return true;
+ }
+
+//****************************************************************************************************************
+// Закрывает файл текущих данных счетчика, записи из буфера сохраняются на карту
+// При извлечении карты записи, не сохраненные DatSync(), теряются
+// uint8_t meter - индекс счетчика
+//****************************************************************************************************************
+static void DatClose( uint8_t meter ) {
+
+    if ( !dat_log[meter].date )
+        return;
+    DatFlush( meter );
+    f_close( &dat_log[meter].file );
+    dat_log[meter].date = 0;
+    dat_log[meter].len = 0;
+ }
+
+//****************************************************************************************************************
+// Сохраняет на карту записи, добавленные в файлы GLB_LOG_SYNC и более сек назад: буфер записывается 
+// в файл, размер файла и элемент каталога обновляются. Записи без ограничения по времени хранения 
+// записываются в файл только целыми секторами. Файл, сохранение которого не выполнено, закрывается 
+// и будет открыт заново при следующей записи
+//****************************************************************************************************************
+static void DatSync( void ) {
+
+    uint8_t meter;
+    uint32_t age;
+    LOG_FILE *log;
+
+    age = GlbParamGet( GLB_LOG_SYNC, GLB_PARAM_VALUE ) * 1000UL;
+    for ( meter = 0; meter < MERC_DEV_MAX; meter++ ) {
+        log = &dat_log[meter];
+        if ( !log->date || log->pending == false || HAL_GetTick() - log->time < age )
+            continue;
+        log->pending = false;
+        if ( DatFlush( meter ) == false || f_sync( &log->file ) != FR_OK ) {
+            err_file++;
+            DatClose( meter );
+           }
+       }
+ }
+
+//****************************************************************************************************************
+// Формирует имя файла данных счетчика
+// Для первого счетчика: YYYYMM/YYYYMMDD_dat.csv или YYYY_tar.csv, для следующих счетчиков к имени 
+// добавляется номер счетчика: YYYYMM/YYYYMMDD_dat2.csv, YYYY_tar2.csv
+// char *path    - буфер для имени файла
+// bool daily    - true - ежедневный файл в каталоге месяца, false - годовой файл
+// char *name    - суффикс имени файла: "_dat", "_tar"
+// uint8_t meter - индекс счетчика
+// char *ext     - расширение имени файла: ".csv", ".bin"
+// timedate *tm  - дата записи
+//****************************************************************************************************************
+static void LogFileName( char *path, bool daily, char *name, uint8_t meter, char *ext, timedate *tm ) {
+
+    char numb[4];
+
+    memset( path, 0x00, LOG_PATH_SIZE );
+    if ( daily == true )
+        sprintf( path, "%04u%02u/%04u%02u%02u", tm->td_year, tm->td_month, tm->td_year, tm->td_month, tm->td_day );
+    else sprintf( path, "%04u", tm->td_year );
+    strcat( path, name );
+    if ( meter ) {
+        sprintf( numb, "%u", meter + 1 );
+        strcat( path, numb );
+       }
+    strcat( path, ext );
+ }
+
+//****************************************************************************************************************
+// Формирует имя каталога месяца YYYYMM для файлов за указанную дату
+// char *path    - буфер для имени каталога
+// timedate *tm  - дата записи
+//****************************************************************************************************************
+static void LogDirName( char *path, timedate *tm ) {
+
+    memset( path, 0x00, LOG_PATH_SIZE );
+    sprintf( path, "%04u%02u", tm->td_year, tm->td_month );
+ }
+
 //****************************************************************************************************************
 // Возвращает кол-во ошибок записи данных
 // uint8_t id_error - идентификатор типа ошибки
@@ -174,3 +448,29 @@ uint16_t DataLogerError( uint8_t id_error ) {
         return err_file;
     return 0;
  }
+
+//****************************************************************************************************************
+// Возвращает значение статистики записи файлов текущих данных
+// uint8_t id_stat - идентификатор значения, см. LOG_STAT_*
+// return          - значение
+//****************************************************************************************************************
+uint32_t DataLogerStat( uint8_t id_stat ) {
+
+    uint8_t meter;
+    uint32_t value = 0;
+
+    if ( id_stat == LOG_STAT_BUFFERED ) {
+        for ( meter = 0; meter < MERC_DEV_MAX; meter++ )
+            value += dat_log[meter].len;
+        return value;
+       }
+    if ( id_stat == LOG_STAT_DATA )
+        return stat_data;
+    if ( id_stat == LOG_STAT_FLUSH )
+        return stat_flush;
+    if ( id_stat == LOG_STAT_SECTOR )
+        return SD_Write_Count();
+    if ( id_stat == LOG_STAT_AMPLIFY && stat_data )
+        return (uint64_t)SD_Write_Count() * LOG_SECTOR_SIZE * 100 / stat_data;
+    return 0;
+ }
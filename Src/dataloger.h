@@ -7,7 +7,50 @@
 #define GET_ERROR_MAKE_DIR          0           //ошибки создания каталога
 #define GET_ERROR_OPEN_FILE         1           //ошибки открытия файлов
 
+//статистика записи файлов текущих данных, см. DataLogerStat()
+#define LOG_STAT_BUFFERED           0           //кол-во байт записей в буферах
+#define LOG_STAT_DATA               1           //кол-во байт записей, принятых для записи
+#define LOG_STAT_FLUSH              2           //кол-во записей буферов в файлы
+#define LOG_STAT_SECTOR             3           //кол-во блоков, записанных на карту (все файлы, FAT, каталоги)
+#define LOG_STAT_AMPLIFY            4           //увеличение объема записи: байт блоков / байт записей * 100
+#define LOG_STAT_CNT                5
+
+//двоичный файл текущих данных счетчика YYYYMMDD_dat.bin: заголовок LOG_BIN_HEADER, далее записи LOG_BIN_RECORD
+//все значения little-endian, преобразование в CSV - утилита Tools/logconv.c
+#define LOG_BIN_MAGIC               "PLOG"      //сигнатура файла
+#define LOG_BIN_VERSION             1           //версия формата записи
+
+#define LOG_BIN_TIME_MASK           0x0001FFFF  //секунды от начала суток даты заголовка
+#define LOG_BIN_VALID               0x80000000  //признак достоверности значений U, I, P
+
+#pragma pack( push, 1 )
+
+//заголовок двоичного файла, 16 байт
+typedef struct {
+    char     magic[4];                          //сигнатура LOG_BIN_MAGIC
+    uint8_t  version;                           //версия формата записи LOG_BIN_VERSION
+    uint8_t  hdr_size;                          //размер заголовка (байт)
+    uint8_t  rec_size;                          //размер записи (байт)
+    uint8_t  meter;                             //индекс счетчика
+    uint16_t year;                              //дата файла, от начала которой отсчитывается время записей
+    uint8_t  month;
+    uint8_t  day;
+    uint32_t number;                            //номер счетчика
+ } LOG_BIN_HEADER;
+
+//запись двоичного файла, 12 байт
+typedef struct {
+    uint32_t time;                              //время записи и признак достоверности, см. LOG_BIN_TIME_MASK, LOG_BIN_VALID
+    uint16_t voltage;                           //напряжение сети (0.1 V)
+    uint16_t current;                           //ток в нагрузке (0.01 A)
+    uint16_t power;                             //мощность нагрузки (W), не более UINT16_MAX
+    uint16_t age;                               //возраст значений (сек), 0xFFFF - значения не получены
+ } LOG_BIN_RECORD;
+
+#pragma pack( pop )
+
 void DataLogerInit( void );
 uint16_t DataLogerError( uint8_t id_error );
+uint32_t DataLogerStat( uint8_t id_stat );
 
 #endif
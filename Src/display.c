@@ -19,6 +19,7 @@
 #include "display.h"
 #include "xtime.h"
 #include "dataloger.h"
+#include "mercury.h"
 
 #include "cmsis_os.h"
 #include "stm32f1xx_hal.h"
@@ -67,7 +68,9 @@ extern IWDG_HandleTypeDef hiwdg;
 #define DISPLAY_INFO_TARIFF     3           //вывод значений тариф день/ночь
 #define DISPLAY_INFO_LINKSTAT   4           //состояние связи со счетчиком
 #define DISPLAY_INFO_SDSTAT     5           //ошибки записи файлов
-#define DISPLAY_INFO_FIRST      6           //переход на первый элемент
+#define DISPLAY_INFO_POLLRATE   6           //фактическая частота опроса счетчика
+#define DISPLAY_INFO_LINKCNT    7           //статистика обмена со счетчиком, сброс кнопкой ESC
+#define DISPLAY_INFO_FIRST      8           //переход на первый элемент
 
 //код вывода значений для режима DISPLAY_MODE_PARAM
 #define DISPLAY_PARAM_MERCNUMB  1           //вывод номера счетчика
@@ -78,7 +81,8 @@ extern IWDG_HandleTypeDef hiwdg;
 #define DISPLAY_PARAM_DEVSPEED  6           //скорость обмена в сети MODBUS
 #define DISPLAY_PARAM_LOGGING   7           //признак логирования информации с счетчика на SD карту
 #define DISPLAY_PARAM_INTVLOG   8           //интервал логирования на SD карту (в секундах)
-#define DISPLAY_PARAM_FIRST     9           //переход на первый элемент
+#define DISPLAY_PARAM_VALAGE    9           //максимальный возраст значений счетчика (в секундах)
+#define DISPLAY_PARAM_FIRST     10          //переход на первый элемент
 
 //структура для описания меню параметров
 typedef struct {
@@ -126,6 +130,7 @@ static const DISPLAY display[DISPLAY_PARAM_FIRST] = {
     { 1, 1, "Скорость обмена",   1, 2, "ModBus: %u ",       9,  2, "",  "",            0, 11                                }, //скорость уст-ва в сети ModBus
     { 3, 1, "Логирование",       3, 2, "данных: %s",        11, 2, "",  "",            0, 2                                 }, //признак логирования данных
     { 1, 1, "Интервал лог-ния",  1, 2, "данных: %03u сек",  9,  2, "",  "___",         5, 255                               }, //интервал логирования данных
+    { 1, 1, "Возраст значений",  1, 2, "макс: %05u сек",    7,  2, "",  "_____",       10, UINT16_MAX + 1                   }, //максимальный возраст значений
  };
         
 //****************************************************************************************************************
@@ -138,6 +143,7 @@ static void SetDataEdit( char *str );
 static void DataEditOut( void );
 static uint32_t GetDataEdit( uint8_t element );
 static uint8_t DataEditSave( void );
+static unsigned long CountLimit( uint32_t value, uint32_t max );
 
 //****************************************************************************************************************
 // Локальные прототипы функций потоков и таймеров
@@ -261,6 +267,11 @@ static void ThreadKey( void const *arg ) {
                 //редактирование выключено, выход из режима просмотра параметров
                 if ( mode_edit == false && display_mode == DISPLAY_MODE_PARAM )
                     DisplayMode( DISPLAY_MODE_INFO ); 
+                //сброс статистики обмена со счетчиками
+                if ( display_mode == DISPLAY_MODE_INFO && display_subm == DISPLAY_INFO_LINKCNT ) {
+                    LinkStatReset();
+                    osSignalSet( tid_ThreadDisplayOut, EVN_DISP_UPDATE );
+                   }
                }
             if ( event.value.signals & EVN_KEY_UP ) {
                 if ( confirm != CONFIRM_OFF )
@@ -383,6 +394,7 @@ static void ThreadDisplayOut( void const *arg ) {
 
     uint8_t pos;
     timedate tm;
+    MERC_VALUES values;
     char str1[20], str2[20];
 
     while ( true ) {
@@ -411,23 +423,25 @@ static void ThreadDisplayOut( void const *arg ) {
                }
             if ( display_subm == DISPLAY_INFO_INSTVAL ) {
                 //вывод мгновенных значений счетчика
+                GetSnapshot( 0, &values );
                 LCDGotoXY( 1, 1 );
-                sprintf( str1, "U=%05.1fV", ((float)GetData( INSTVAL_VOLTAGE ))/10 );
+                sprintf( str1, "U=%05.1fV", ((float)values.voltage)/10 );
                 LCDPuts( str1 );
                 LCDGotoXY( 10, 1 );
-                sprintf( str1, "I=%.2fA ", ((float)GetData( INSTVAL_CURRENT ))/100 );
+                sprintf( str1, "I=%.2fA ", ((float)values.current)/100 );
                 LCDPuts( str1 );
-                sprintf( str2, "P=%05uW", GetData( INSTVAL_POWER ) );
+                sprintf( str2, "P=%05uW", values.power );
                 LCDGotoXY( 1, 2 );
                 LCDPuts( str2 );
                }
             if ( display_subm == DISPLAY_INFO_TARIFF ) {
                 //вывод накопленных значений тарифов
+                GetSnapshot( 0, &values );
                 LCDGotoXY( 1, 1 );
-                sprintf( str1, "День:%08.2fkWh", ((float)GetData( INSTVAL_TARIFF1 ))/100 );
+                sprintf( str1, "День:%08.2fkWh", ((float)values.tariff1)/100 );
                 LCDPuts( str1 );
                 LCDGotoXY( 1, 2 );
-                sprintf( str2, "Ночь:%08.2fkWh", ((float)GetData( INSTVAL_TARIFF2 ))/100 );
+                sprintf( str2, "Ночь:%08.2fkWh", ((float)values.tariff2)/100 );
                 LCDPuts( str2 );
                }
             if ( display_subm == DISPLAY_INFO_LINKSTAT ) {
@@ -435,7 +449,7 @@ static void ThreadDisplayOut( void const *arg ) {
                 LCDGotoXY( 1, 1 );
                 LCDPuts( "Состояние связи" );
                 //центрирование строки состояния
-                sprintf( str2, "%s", GetStatus() );
+                sprintf( str2, "%s", GetStatus( 0 ) );
                 pos = ( 16 - strlen( str2 ) )/2;
                 if ( !pos )
                     pos = 1;
@@ -450,6 +464,26 @@ static void ThreadDisplayOut( void const *arg ) {
                 sprintf( str2, "MD:%04u FO:%05u", DataLogerError( GET_ERROR_MAKE_DIR ), DataLogerError( GET_ERROR_OPEN_FILE ) );
                 LCDPuts( str2 );
                }
+            if ( display_subm == DISPLAY_INFO_POLLRATE ) {
+                //вывод фактической частоты опроса счетчика (ответов в минуту)
+                LCDGotoXY( 1, 1 );
+                sprintf( str1, "U,I,P:%5u/мин", GetPollRate( 0, INSTANTVAL ) );
+                LCDPuts( str1 );
+                LCDGotoXY( 1, 2 );
+                sprintf( str2, "Тариф:%5u/мин", GetPollRate( 0, POWERTAR ) );
+                LCDPuts( str2 );
+               }
+            if ( display_subm == DISPLAY_INFO_LINKCNT ) {
+                //вывод кол-ва запросов по результатам обмена: успешно, нет ответа, ошибка КС, 
+                //ошибка ответа + нет эхо, значения ограничены размером поля
+                LCDGotoXY( 1, 1 );
+                sprintf( str1, "Ok:%05lu Н:%05lu", CountLimit( GetLinkTotal( 0, 0 ), 99999 ), CountLimit( GetLinkTotal( 0, 1 ), 99999 ) );
+                LCDPuts( str1 );
+                LCDGotoXY( 1, 2 );
+                sprintf( str2, "КС:%04lu Ош:%04lu", CountLimit( GetLinkTotal( 0, 2 ), 9999 ), 
+                         CountLimit( GetLinkTotal( 0, 3 ) + GetLinkTotal( 0, 4 ), 9999 ) );
+                LCDPuts( str2 );
+               }
            }
         //*********************************************************************************************
         // вывод значений параметров настройки
@@ -480,6 +514,8 @@ static void ThreadDisplayOut( void const *arg ) {
                 sprintf( str2, display[display_subm].str2, GlbParamGet( GLB_DATA_LOG, GLB_PARAM_VALUE ) ? "Да " : "Нет" );
             if ( display_subm == DISPLAY_PARAM_INTVLOG )
                 sprintf( str2, display[display_subm].str2, GlbParamGet( GLB_LOG_INTERVAL, GLB_PARAM_VALUE ) );
+            if ( display_subm == DISPLAY_PARAM_VALAGE )
+                sprintf( str2, display[display_subm].str2, GlbParamGet( GLB_VALUE_AGE, GLB_PARAM_VALUE ) );
             SetDataEdit( str2 );
             LCDPuts( str2 );
            }
@@ -728,8 +764,11 @@ static uint8_t DataEditSave( void ) {
     if ( display_subm == DISPLAY_PARAM_MERCSPEED ) {
         old_val = GlbParamGet( GLB_MERCURY_SPEED, GLB_PARAM_VALUE );
         new_val = GetDataEdit( 0 );
-        if ( old_val != new_val )
+        if ( old_val != new_val ) {
             result = GlbParamSave( GLB_MERCURY_SPEED, new_val );
+            if ( result == HAL_OK )
+                DataSpeedChange(); //новая скорость применяется без перезапуска
+           }
        }
     //установка времени
     if ( display_subm == DISPLAY_PARAM_SETTIME ) {
@@ -812,6 +851,13 @@ static uint8_t DataEditSave( void ) {
         if ( old_val != new_val )
             result = GlbParamSave( GLB_LOG_INTERVAL, new_val );
        }
+    //максимальный возраст значений счетчика
+    if ( display_subm == DISPLAY_PARAM_VALAGE ) {
+        old_val = GlbParamGet( GLB_VALUE_AGE, GLB_PARAM_VALUE );
+        new_val = GetDataEdit( 0 );
+        if ( old_val != new_val )
+            result = GlbParamSave( GLB_VALUE_AGE, new_val );
+       }
     if ( result != HAL_OK ) {
         LCDCls();
         LCDGotoXY( 2, 1 );
@@ -899,3 +945,13 @@ void ThreadLed( void const *arg ) {
       } 
  }
 
+//****************************************************************************************************************
+// Ограничение значения счетчика для вывода в поле фиксированного размера
+// uint32_t value - значение
+// uint32_t max   - максимальное значение
+// return         - значение не превышающее max
+//****************************************************************************************************************
+static unsigned long CountLimit( uint32_t value, uint32_t max ) {
+
+    return ( value > max ) ? max : value;
+ }
@@ -28,9 +28,13 @@
 
 #define EVN_LOG_DATA            0x1000      //сохранение текущих данных (V,I,P)
 #define EVN_LOG_TARIFF          0x2000      //сохранение текущих значений тарифов
+#define EVN_LOG_CLOSE           0x0002      //закрытие файлов данных: логирование выключено, нет SD карты
 #define EVN_LOG_ANY             0x0000      //сохранение данных
 
-#define EVN_485_RECV            0x4000      //
+#define EVN_MERC_RECV           0x0001      //пауза на линии после приема данных от счетчика (поток ThreadRequest)
+#define EVN_MERC_SPEED          0x0002      //изменена скорость обмена со счетчиком в параметрах (поток ThreadRequest)
+
+#define EVN_485_RECV            0x4000      //пауза t3.5 на шине MODBUS после приема запроса (поток Thread485Recv)
 #define EVN_485_TIMER           0x8000      //
 
 #endif
@@ -30,6 +30,12 @@ typedef struct {
     uint16_t crc;                       //контрольная сумма
  } MERC_REQUEST;
 
+//Заголовок ответа
+typedef struct {
+    uint32_t num_dev;                   //номер счетчика
+    uint8_t  command;                   //код команды
+ } MERC_HEADER;
+
 //Ответ - мгновенные значения ток, напряжение, мощность
 typedef struct {
     uint32_t num_dev;                   //номер счетчика (эхо команды)
@@ -10,16 +10,190 @@
 #include "data.h"
 #include "crc16.h"
 #include "param.h"
+#include "xtime.h"
 #include "modbus.h"
+#include "dataloger.h"
 
 #include "modbus_def.h"
 #include "mercury_ext.h"
+#include "stm32f1xx_hal.h"
 
 //*****************************************************************************************
 // Локальные константы
 //*****************************************************************************************
 #define MAX_DATA_CRC        2               //кол-во байт для хранения КС
 
+#ifndef FUNC_WR_SING_REG
+#define FUNC_WR_SING_REG    0x06            //запись одного регистра хранения
+#endif
+#ifndef FUNC_WR_MULT_REG
+#define FUNC_WR_MULT_REG    0x10            //запись нескольких регистров хранения
+#endif
+#ifndef MB_ERROR_VALUE
+#define MB_ERROR_VALUE      0x03            //недопустимое значение в запросе
+#endif
+#ifndef MB_ERROR_DEVICE
+#define MB_ERROR_DEVICE     0x04            //ошибка выполнения запроса (запись FLASH/RTC)
+#endif
+#ifndef FUNC_DIAGNOSTIC
+#define FUNC_DIAGNOSTIC     0x08            //диагностика линии
+#endif
+#ifndef FUNC_DEV_IDENT
+#define FUNC_DEV_IDENT      0x2B            //инкапсулированный интерфейс, MEI_DEV_IDENT - идентификация уст-ва
+#endif
+#ifndef FUNC_RD_FIFO
+#define FUNC_RD_FIFO        0x18            //чтение очереди FIFO
+#endif
+#define MEI_DEV_IDENT       0x0E            //тип MEI: чтение идентификации уст-ва
+
+#define MB_FRAME_MAX        256             //максимальный размер фрейма MODBUS RTU
+
+//подфункции диагностики FUNC_DIAGNOSTIC
+#define DIAG_RET_QUERY      0x00            //возврат данных запроса
+#define DIAG_CLR_COUNTERS   0x0A            //сброс счетчиков диагностики
+#define DIAG_BUS_MSG        0x0B            //кол-во фреймов на линии
+#define DIAG_BUS_ERR        0x0C            //кол-во ошибок связи (КС)
+#define DIAG_BUS_EXCEPTION  0x0D            //кол-во ответов с ошибкой
+#define DIAG_SRV_MSG        0x0E            //кол-во запросов к уст-ву
+#define DIAG_SRV_NO_RESP    0x0F            //кол-во запросов без ответа
+#define DIAG_BUS_OVERRUN    0x12            //кол-во ошибок переполнения приемника
+
+//идентификация уст-ва FUNC_DEV_IDENT: код чтения и объекты
+#define DEVID_BASIC         0x01            //потоковое чтение основных объектов 0x00 - 0x02
+#define DEVID_REGULAR       0x02            //потоковое чтение объектов 0x00 - 0x7F
+#define DEVID_EXTENDED      0x03            //потоковое чтение объектов 0x00 - 0xFF
+#define DEVID_SPECIFIC      0x04            //чтение одного объекта
+#define DEVID_CONFORMITY    0x83            //уровень соответствия: расширенная идентификация, потоковое и 
+                                            //индивидуальное чтение
+#define DEVID_VALUE_MAX     32              //максимальный размер строки значения объекта
+#define DEVID_VENDOR        0x00            //производитель
+#define DEVID_PRODUCT       0x01            //код изделия
+#define DEVID_REVISION      0x02            //версия ПО контроллера
+#define DEVID_METER         0x80            //объекты счетчиков: 0x80 + индекс счетчика * 2 - серийный номер, 
+                                            //0x81 + индекс счетчика * 2 - версия ПО счетчика
+
+#define MB_REG_RD_MAX       125             //максимальное кол-во регистров в запросе FUNC_RD_HOLD_REG
+#define MB_REG_WR_MAX       123             //максимальное кол-во регистров в запросе FUNC_WR_MULT_REG
+
+//права доступа к регистру
+#define MB_ACCESS_RD        0x01            //чтение
+#define MB_ACCESS_WR        0x02            //запись
+
+//коды значений счетчика для RegValue()
+#define VAL_LINK            0               //результат последнего обмена
+#define VAL_VOLTAGE         1               //напряжение сети
+#define VAL_CURRENT         2               //ток в нагрузке
+#define VAL_POWER           3               //мощность нагрузки
+#define VAL_TARIFF1         4               //дневной тариф
+#define VAL_TARIFF2         5               //ночной тариф
+#define VAL_QUALITY         6               //признаки достоверности значений
+#define VAL_AGE_INST        7               //возраст мгновенных значений
+#define VAL_AGE_TARIFF      8               //возраст значений тарифов
+
+//признаки представления значения регистра
+#define REG_FLOAT           0x01            //значение / scale передается как float32
+#define REG_WORDS           0x02            //порядок слов 32-битного значения задается параметром GLB_MBUS_WORDS
+
+//описания регистров: 16 бит, 32 бита (2 регистра, старшее слово первым), дата/время (4 регистра)
+#define REG16( get, arg, access )   { get, arg, 1, 0, access, 1, 0 }
+#define REG32( get, arg, access )   { get, arg, 2, 0, access, 1, 0 }, { get, arg, 2, 1, access, 1, 0 }
+#define REGTIME( arg, access )      { RegTime, arg, 4, 0, access, 1, 0 }, { RegTime, arg, 4, 1, access, 1, 0 }, \
+                                    { RegTime, arg, 4, 2, access, 1, 0 }, { RegTime, arg, 4, 3, access, 1, 0 }
+//значения счетчика 32 бита: uint32 и float32, порядок слов по параметру GLB_MBUS_WORDS
+#define VAL32( arg )                { RegValue, arg, 2, 0, MB_ACCESS_RD, 1, REG_WORDS }, \
+                                    { RegValue, arg, 2, 1, MB_ACCESS_RD, 1, REG_WORDS }
+#define FLT32( arg, scale )         { RegValue, arg, 2, 0, MB_ACCESS_RD, scale, REG_FLOAT | REG_WORDS }, \
+                                    { RegValue, arg, 2, 1, MB_ACCESS_RD, scale, REG_FLOAT | REG_WORDS }
+
+//блок регистров параметров настроек и часов контроллера, чтение (0x03) и запись (0x06, 0x10)
+//запись нескольких регистров выполняется целиком или не выполняется совсем, 
+//измененные параметры сохраняются во FLASH одним циклом стирания/записи
+#define MB_REG_CONF_BASE    0x0800          //адрес блока регистров параметров
+
+//смещения регистров в блоке параметров, значения 32 бита: 2 регистра, старшее слово первым
+#define MB_CONF_MERCNUMB    0x00            //номер счетчика, 2 регистра
+#define MB_CONF_MERCSPEED   0x02            //индекс скорости обмена со счетчиком 0 - 4
+#define MB_CONF_MBUSID      0x03            //номер уст-ва в сети ModBus 1 - 247
+#define MB_CONF_MBUSSPEED   0x04            //индекс скорости обмена в сети ModBus 0 - 11
+#define MB_CONF_LOGGING     0x05            //логирование данных 0/1
+#define MB_CONF_INTVLOG     0x06            //интервал логирования данных (сек) 5 - 255
+#define MB_CONF_MERCCNT     0x07            //кол-во счетчиков на линии 1 - MERC_DEV_MAX
+#define MB_CONF_VALAGE      0x08            //максимальный возраст значений (сек)
+#define MB_CONF_MERCNUMB2   0x09            //номера второго ... четвертого счетчиков, по 2 регистра
+#define MB_CONF_WORDS       0x0F            //порядок слов 32-битных значений счетчика, см. MBUS_WORDS_*
+#define MB_CONF_DATETIME    0x10            //часы контроллера, 4 регистра, см. TimeValue()
+#define MB_CONF_LOGSYNC     0x14            //интервал сохранения буферов файлов данных (сек) 0 - 254
+#define MB_CONF_LOGFMT      0x15            //формат файлов текущих данных, см. LOG_FORMAT_*
+#define MB_CONF_MAX         0x16            //кол-во регистров в блоке параметров
+
+//блоки регистров данных счетчиков, для каждого счетчика на линии выделен отдельный блок
+//адрес регистра = MB_REG_METER_BASE + индекс счетчика * MB_REG_METER_SIZE + смещение в блоке
+#define MB_REG_METER_BASE   0x1000          //адрес блока регистров первого счетчика
+#define MB_REG_METER_SIZE   0x0100          //размер адресного пространства блока одного счетчика
+
+//смещения регистров в блоке данных счетчика
+#define MB_METER_LINK       0x00            //состояние связи со счетчиком
+#define MB_METER_VOLTAGE    0x01            //мгновенное значение напряжения
+#define MB_METER_CURRENT    0x02            //мгновенное значение тока
+#define MB_METER_POWER      0x03            //мгновенное значение мощности
+#define MB_METER_TARIFF1    0x04            //накопленное значение, дневной тариф
+#define MB_METER_TARIFF2    0x05            //накопленное значение, ночной тариф
+#define MB_METER_QUALITY    0x06            //признаки достоверности значений, см. VALUE_*
+#define MB_METER_AGE_INST   0x07            //возраст мгновенных значений (сек), 0xFFFF - значения не получены
+#define MB_METER_AGE_TARIFF 0x08            //возраст значений тарифов (сек)
+#define MB_METER_ATTR       0x10            //маска прочитанных атрибутов счетчика, см. ATTR_*
+#define MB_METER_SERIAL     0x11            //серийный номер, 2 регистра (старшее слово первым)
+#define MB_METER_VERSION    0x13            //версия ПО, 2 регистра (байт1 << 8 | байт2, байт3)
+#define MB_METER_DATEPROD   0x15            //дата выпуска, 2 регистра (год, месяц << 8 | день)
+#define MB_METER_LASTON     0x17            //последнее включение, 4 регистра, см. TimeValue()
+#define MB_METER_LASTOFF    0x1B            //последнее выключение, 4 регистра
+#define MB_METER_DATETIME   0x1F            //часы счетчика, 4 регистра
+#define MB_METER_U32        0x30            //U (0.1 V), I (0.01 A), P (W), T1, T2 (0.01 kWh): uint32, по 2 регистра
+#define MB_METER_FLOAT      0x40            //U (V), I (A), P (W), T1, T2 (kWh): float32, по 2 регистра
+#define MB_METER_MAX        0x4A            //кол-во регистров в блоке данных счетчика
+
+//блоки регистров статистики обмена со счетчиками, все значения 32 бита: 2 регистра, старшее слово первым
+//адрес регистра = MB_REG_STAT_BASE + индекс счетчика * MB_REG_METER_SIZE + смещение в блоке
+#define MB_REG_STAT_BASE    0x2000          //адрес блока статистики первого счетчика
+
+//смещения регистров в блоке статистики
+#define MB_STAT_LINK        0x00            //кол-во запросов: индекс команды * MB_STAT_CMND_SIZE + результат * 2
+#define MB_STAT_CMND_SIZE   ( LINK_STAT_CNT * 2 )
+#define MB_STAT_LATENCY     ( MERC_CMND_CNT * MB_STAT_CMND_SIZE ) //гистограмма времени ответа: интервал * 2
+#define MB_STAT_MAX         ( MB_STAT_LATENCY + LATENCY_CNT * 2 ) //кол-во регистров в блоке статистики
+
+//блок регистров диагностики: статистика времени ответа на запросы MODBUS, см. RS485Latency()
+//значения 32 бита: 2 регистра, старшее слово первым, время в мкс
+#define MB_REG_DIAG_BASE    0x3000          //адрес блока регистров диагностики
+
+//смещения регистров в блоке диагностики
+#define MB_DIAG_RESET       0x00            //запись любого значения - сброс статистики, читается 0
+#define MB_DIAG_LATENCY     0x02            //статистика: группа функций * MB_DIAG_FUNC_SIZE + значение * 2
+#define MB_DIAG_FUNC_SIZE   ( MBUS_LAT_CNT * 2 )
+#define MB_DIAG_LOG         ( MB_DIAG_LATENCY + MBUS_FUNC_CNT * MB_DIAG_FUNC_SIZE ) //статистика записи файлов данных:
+                                            //значение * 2, см. LOG_STAT_*, не сбрасывается
+#define MB_DIAG_MAX         ( MB_DIAG_LOG + LOG_STAT_CNT * 2 ) //кол-во регистров в блоке
+
+//блок регистров истории мгновенных значений счетчиков, см. HistRead()
+//окно возвращает выборки, номер которых больше курсора: мастер записывает в курсор номер последней
+//полученной выборки и читает окно, при потере выборок окно начинается с самой старой выборки.
+//Адрес MB_REG_HIST_BASE также является адресом очереди FIFO (0x18): последние MB_FIFO_REC_CNT выборок
+#define MB_REG_HIST_BASE    0x4000          //адрес блока регистров истории
+
+//смещения регистров в блоке истории, значения 32 бита: 2 регистра, старшее слово первым
+#define MB_HIST_CURSOR      0x00            //курсор: номер последней полученной выборки, чтение/запись (0x10)
+#define MB_HIST_LAST        0x02            //номер последней выборки
+#define MB_HIST_FIRST       0x04            //номер самой старой выборки в истории
+#define MB_HIST_COUNT       0x06            //кол-во выборок новее курсора
+#define MB_HIST_WINDOW      0x08            //выборки новее курсора, по MB_HIST_REC_SIZE регистров:
+                                            //номер (2 регистра), время (2 регистра, сек от 01.01.1970),
+                                            //индекс счетчика << 8 | признаки достоверности, U (0.1 V), 
+                                            //I (0.01 A), P (W), номер 0 - выборки нет
+#define MB_HIST_REC_SIZE    8               //кол-во регистров выборки
+#define MB_HIST_REC_CNT     14              //кол-во выборок в окне
+#define MB_HIST_MAX         ( MB_HIST_WINDOW + MB_HIST_REC_CNT * MB_HIST_REC_SIZE ) //кол-во регистров в блоке
+#define MB_FIFO_REC_CNT     3               //кол-во выборок в ответе FUNC_RD_FIFO (не более 31 регистра)
+
 //*****************************************************************************************
 // Локальные переменные 
 //*****************************************************************************************
@@ -33,13 +207,31 @@ typedef struct {
     uint16_t crc;                           //контрольная сумма
  } REQ_RD_REG;
 
+//запись регистра FUNC_WR_SING_REG (0x06), ответ на запросы FUNC_WR_SING_REG, FUNC_WR_MULT_REG (0x10)
+typedef struct {
+    uint8_t dev_addr;                       //Адрес устройства
+    uint8_t function;                       //Функциональный код
+    uint16_t addr_reg;                      //Адрес регистра
+    uint16_t value;                         //Значение регистра (0x06) или количество регистров (0x10)
+    uint16_t crc;                           //контрольная сумма
+ } REQ_WR_REG;
+
+//запись нескольких регистров FUNC_WR_MULT_REG (0x10), заголовок запроса
+typedef struct {
+    uint8_t dev_addr;                       //Адрес устройства
+    uint8_t function;                       //Функциональный код
+    uint16_t addr_reg;                      //Адрес регистра
+    uint16_t cnt_reg;                       //Количество регистров
+    uint8_t cnt_byte;                       //Количество байт данных регистров
+ } REQ_WR_REGS;
+
 //*****************************************************************************************
 //Структура данных ответа на запросы (0x03) чтение нескольких регистров
 typedef struct {
     uint8_t dev_addr;                       //Адрес устройства
     uint8_t function;                       //Функциональный код
     uint8_t cnt_byte;                       //Количество байт данных регистров
-    uint16_t data_reg[EXMER_REG_RD_MAX+1];  //Значения регистров + КС
+    uint16_t data_reg[MB_REG_RD_MAX+1];     //Значения регистров + КС
  } ANSW_RD_REGS;
 
 //Структура данных ответа с ошибкой
@@ -50,51 +242,274 @@ typedef struct {
     uint16_t crc;                           //КС
  } ANSW_ERROR;
 
+//Структура данных ответа на запрос диагностики (0x08) со значением счетчика
+typedef struct {
+    uint8_t  dev_addr;                      //Адрес устройства
+    uint8_t  function;                      //Функциональный код
+    uint16_t sub_func;                      //Код подфункции
+    uint16_t value;                         //Значение счетчика
+    uint16_t crc;                           //КС
+ } ANSW_DIAG;
+
+//Ответ на чтение всего блока данных счетчика, формируется потоком опроса счетчика
+typedef struct {
+    uint8_t dev_addr;                       //Адрес устройства
+    uint8_t function;                       //Функциональный код
+    uint8_t cnt_byte;                       //Количество байт данных регистров
+    uint16_t data_reg[MB_METER_MAX+1];      //Значения регистров (старший байт первым) + КС
+ } ANSW_METER;
+
 #pragma pack( pop )
 
+//образ регистров блока данных счетчика
+typedef struct {
+    uint8_t words;                          //порядок слов 32-битных значений при формировании образа
+    ANSW_METER answ;                        //готовый ответ на чтение всего блока
+ } REG_IMAGE;
+
+//описание регистра
+typedef struct _reg_desc REG_DESC;
+typedef uint32_t ( *REG_GET )( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc );
+
+struct _reg_desc {
+    REG_GET  get;                           //функция чтения значения, NULL - регистр не используется:
+                                            //читается как 0, запись игнорируется
+    uint8_t  arg;                           //параметр функции чтения: код значения, атрибута, параметра
+    uint8_t  width;                         //кол-во регистров значения: 1, 2 - 32 бита, 4 - дата/время
+    uint8_t  index;                         //номер регистра в значении, 0 - первый (старшее слово)
+    uint8_t  access;                        //права доступа, см. MB_ACCESS_*
+    uint16_t scale;                         //делитель значения, 1 - без масштабирования
+    uint8_t  flags;                         //признаки представления значения, см. REG_FLOAT, REG_WORDS
+ };
+
+//описание блока регистров
+typedef struct _reg_block REG_BLOCK;
+
+struct _reg_block {
+    uint16_t base;                          //адрес первого регистра блока
+    uint16_t cnt;                           //кол-во регистров в блоке
+    bool     meter;                         //блок выделяется каждому счетчику с шагом MB_REG_METER_SIZE
+    const REG_DESC *desc;                   //описания регистров, индекс - смещение регистра в блоке
+    uint16_t ( *get )( uint8_t meter, uint16_t offset ); //чтение регистра для блока без описаний (desc = NULL)
+    //запись регистров, NULL - блок только для чтения, результат - код ошибки MODBUS, 0 - успешно
+    uint8_t ( *set )( const REG_BLOCK *block, uint16_t offset, uint16_t cnt_reg, uint8_t *data );
+ };
+
 REQ_RD_REG   req_rd_reg;
+REQ_WR_REG   wr_reg;
+REQ_WR_REGS  req_wr_regs;
 ANSW_RD_REGS rd_regs;
 ANSW_ERROR   answ_error;
+ANSW_DIAG    answ_diag;
+//ответы переменной структуры: возврат данных запроса (0x08), идентификация уст-ва (0x2B)
+static uint8_t answ_buff[MB_FRAME_MAX];
+
+//соответствие подфункций диагностики и счетчиков линии, см. RS485Count()
+static const uint8_t diag_count[][2] = {
+    { DIAG_BUS_MSG,       MBUS_CNT_BUS_MSG   },
+    { DIAG_BUS_ERR,       MBUS_CNT_BUS_ERR   },
+    { DIAG_BUS_EXCEPTION, MBUS_CNT_EXCEPTION },
+    { DIAG_SRV_MSG,       MBUS_CNT_SRV_MSG   },
+    { DIAG_SRV_NO_RESP,   MBUS_CNT_NO_RESP   },
+    { DIAG_BUS_OVERRUN,   MBUS_CNT_OVERRUN   }
+ };
+
+//курсор окна истории и выборки окна для текущего запроса, см. HistRegister()
+static uint32_t hist_cursor;
+static HIST_SAMPLE hist_buff[MB_HIST_REC_CNT];
+
+//основные объекты идентификации уст-ва
+static const char * const dev_ident[] = { "SRG", "Mercury 200.2 Data logger", "V2.0" };
+
+//образы регистров блоков данных счетчиков, двойная буферизация: поток опроса заполняет
+//неактивный буфер, младший бит номера обновления указывает текущий буфер, см. ModbusImage()
+static REG_IMAGE meter_image[MERC_DEV_MAX][2];
+static volatile uint32_t image_seq[MERC_DEV_MAX];
+//таблица поправки КС ответа на чтение всего блока при замене регистров MB_METER_QUALITY - MB_METER_AGE_TARIFF
+static uint16_t image_shift[CRC16_SHIFT_SIZE];
 
 //*****************************************************************************************
 // Прототипы локальных функций
 //*****************************************************************************************
-static bool CrtFrame( uint8_t func, uint16_t adr_reg, uint16_t cnt_reg, uint16_t *data_reg );
-static uint8_t GetRegister( uint16_t *data, uint16_t adr_reg, uint16_t cnt_reg );
+static bool CrtFrame( uint8_t func, uint16_t adr_reg, uint16_t cnt_reg, uint8_t *data_reg );
+static void Diagnostic( uint8_t *data, uint8_t len );
+static void DeviceIdent( uint8_t *data, uint8_t len );
+static void ReadFifo( uint8_t *data, uint8_t len );
+static int DevIdentValue( uint8_t id, char *str );
+static void AnswError( uint8_t func, uint8_t error );
+static const REG_BLOCK *FindBlock( uint16_t adr_reg, uint16_t cnt_reg, uint8_t *meter, uint16_t *offset );
+static bool CheckAccess( const REG_BLOCK *block, uint16_t offset, uint16_t cnt_reg, uint8_t access );
+static uint8_t GetRegister( uint16_t *data, const REG_BLOCK *block, uint8_t meter, uint16_t offset, uint16_t cnt_reg );
+static bool ImageRead( uint8_t meter, uint16_t offset, uint16_t cnt_reg );
+static uint8_t SetConfRegister( const REG_BLOCK *block, uint16_t offset, uint16_t cnt_reg, uint8_t *data );
+static uint32_t RegValue( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc );
+static uint32_t RegReset( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc );
+static uint32_t RegAttrValid( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc );
+static uint32_t RegAttr( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc );
+static uint32_t RegVersion( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc );
+static uint32_t RegDate( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc );
+static uint32_t RegTime( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc );
+static uint32_t RegParam( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc );
+static uint16_t StatRegister( uint8_t meter, uint16_t offset );
+static uint16_t DiagRegister( uint8_t meter, uint16_t offset );
+static uint8_t SetDiagRegister( const REG_BLOCK *block, uint16_t offset, uint16_t cnt_reg, uint8_t *data );
+static uint8_t HistRegister( uint16_t *data, uint16_t offset, uint16_t cnt_reg );
+static uint16_t HistValue( const HIST_SAMPLE *sample, uint8_t index );
+static uint8_t SetHistRegister( const REG_BLOCK *block, uint16_t offset, uint16_t cnt_reg, uint8_t *data );
+static uint16_t TimeValue( timedate *tm, uint8_t index );
 static void Swap16( uint16_t *var );
 
+//*****************************************************************************************
+// Карта регистров
+//*****************************************************************************************
+//регистры первого счетчика (совместимость с предыдущими версиями)
+static const REG_DESC main_desc[EXMER_REG_RD_MAX] = {
+    [EXMER_REG_RD_STAT]    = REG16( RegReset, 0,           MB_ACCESS_RD ),
+    [EXMER_REG_RD_CURRENT] = REG16( RegValue, VAL_CURRENT, MB_ACCESS_RD ),
+    [EXMER_REG_RD_VOLTAGE] = REG16( RegValue, VAL_VOLTAGE, MB_ACCESS_RD ),
+    [EXMER_REG_RD_POWER]   = REG16( RegValue, VAL_POWER,   MB_ACCESS_RD ),
+    [EXMER_REG_RD_TARIFF1] = REG16( RegValue, VAL_TARIFF1, MB_ACCESS_RD ),
+    [EXMER_REG_RD_TARIFF2] = REG16( RegValue, VAL_TARIFF2, MB_ACCESS_RD )
+ };
+
+//блок параметров настроек и часов контроллера
+static const REG_DESC conf_desc[MB_CONF_MAX] = {
+    [MB_CONF_MERCNUMB]  = REG32( RegParam, GLB_MERCURY_NUMB,  MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_MERCSPEED] = REG16( RegParam, GLB_MERCURY_SPEED, MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_MBUSID]    = REG16( RegParam, GLB_MBUS_ID,       MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_MBUSSPEED] = REG16( RegParam, GLB_MBUS_SPEED,    MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_LOGGING]   = REG16( RegParam, GLB_DATA_LOG,      MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_INTVLOG]   = REG16( RegParam, GLB_LOG_INTERVAL,  MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_MERCCNT]   = REG16( RegParam, GLB_MERCURY_CNT,   MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_VALAGE]    = REG16( RegParam, GLB_VALUE_AGE,     MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_MERCNUMB2] = REG32( RegParam, GLB_MERCURY_NUMB2, MB_ACCESS_RD | MB_ACCESS_WR ),
+                          REG32( RegParam, GLB_MERCURY_NUMB3, MB_ACCESS_RD | MB_ACCESS_WR ),
+                          REG32( RegParam, GLB_MERCURY_NUMB4, MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_WORDS]     = REG16( RegParam, GLB_MBUS_WORDS,    MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_DATETIME]  = REGTIME( 0,                         MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_LOGSYNC]   = REG16( RegParam, GLB_LOG_SYNC,      MB_ACCESS_RD | MB_ACCESS_WR ),
+    [MB_CONF_LOGFMT]    = REG16( RegParam, GLB_LOG_FORMAT,    MB_ACCESS_RD | MB_ACCESS_WR )
+ };
+
+//блок данных счетчика
+static const REG_DESC meter_desc[MB_METER_MAX] = {
+    [MB_METER_LINK]       = REG16( RegValue, VAL_LINK,       MB_ACCESS_RD ),
+    [MB_METER_VOLTAGE]    = REG16( RegValue, VAL_VOLTAGE,    MB_ACCESS_RD ),
+    [MB_METER_CURRENT]    = REG16( RegValue, VAL_CURRENT,    MB_ACCESS_RD ),
+    [MB_METER_POWER]      = REG16( RegValue, VAL_POWER,      MB_ACCESS_RD ),
+    [MB_METER_TARIFF1]    = REG16( RegValue, VAL_TARIFF1,    MB_ACCESS_RD ),
+    [MB_METER_TARIFF2]    = REG16( RegValue, VAL_TARIFF2,    MB_ACCESS_RD ),
+    [MB_METER_QUALITY]    = REG16( RegValue, VAL_QUALITY,    MB_ACCESS_RD ),
+    [MB_METER_AGE_INST]   = REG16( RegValue, VAL_AGE_INST,   MB_ACCESS_RD ),
+    [MB_METER_AGE_TARIFF] = REG16( RegValue, VAL_AGE_TARIFF, MB_ACCESS_RD ),
+    [MB_METER_ATTR]       = REG16( RegAttrValid, 0,          MB_ACCESS_RD ),
+    [MB_METER_SERIAL]     = REG32( RegAttr, ATTR_SERIALNUM,  MB_ACCESS_RD ),
+    [MB_METER_VERSION]    = REG32( RegVersion, ATTR_VERSION, MB_ACCESS_RD ),
+    [MB_METER_DATEPROD]   = REG32( RegDate, ATTR_DATEPROD,   MB_ACCESS_RD ),
+    [MB_METER_LASTON]     = REGTIME( ATTR_LASTON,            MB_ACCESS_RD ),
+    [MB_METER_LASTOFF]    = REGTIME( ATTR_LASTOFF,           MB_ACCESS_RD ),
+    [MB_METER_DATETIME]   = REGTIME( ATTR_DATETIME,          MB_ACCESS_RD ),
+    [MB_METER_U32]        = VAL32( VAL_VOLTAGE ), VAL32( VAL_CURRENT ), VAL32( VAL_POWER ), 
+                            VAL32( VAL_TARIFF1 ), VAL32( VAL_TARIFF2 ),
+    [MB_METER_FLOAT]      = FLT32( VAL_VOLTAGE, 10 ), FLT32( VAL_CURRENT, 100 ), FLT32( VAL_POWER, 1 ), 
+                            FLT32( VAL_TARIFF1, 100 ), FLT32( VAL_TARIFF2, 100 )
+ };
+
+//блоки регистров, поиск блока по адресу не зависит от кол-ва регистров в блоках
+#define REG_BLOCK_METER     2               //индекс блока данных счетчика, значения читаются из образа регистров
+#define REG_BLOCK_HIST      5               //индекс блока истории, значения формируются HistRegister()
+
+static const REG_BLOCK reg_block[] = {
+    { 0,                 EXMER_REG_RD_MAX, false, main_desc,  NULL,         NULL            },
+    { MB_REG_CONF_BASE,  MB_CONF_MAX,      false, conf_desc,  NULL,         SetConfRegister },
+    { MB_REG_METER_BASE, MB_METER_MAX,     true,  meter_desc, NULL,         NULL            },
+    { MB_REG_STAT_BASE,  MB_STAT_MAX,      true,  NULL,       StatRegister, NULL            },
+    { MB_REG_DIAG_BASE,  MB_DIAG_MAX,      false, NULL,       DiagRegister, SetDiagRegister },
+    { MB_REG_HIST_BASE,  MB_HIST_MAX,      false, NULL,       NULL,         SetHistRegister }
+ };
+
+//*****************************************************************************************
+// Инициализация образов регистров блока данных счетчика
+// Вызов до запуска потока опроса счетчика
+//*****************************************************************************************
+void ModbusInit( void ) {
+
+    //регистры, рассчитываемые на момент чтения, и КС ответа разделяют регистры после MB_METER_AGE_TARIFF
+    CRC16ShiftInit( image_shift, ( MB_METER_MAX - MB_METER_AGE_TARIFF - 1 ) * 2 );
+ }
+
+//*****************************************************************************************
+// Формирование образа регистров блока данных счетчика: значения регистров в порядке
+// передачи (старший байт первым) и КС ответа на чтение всего блока.
+// Запросы чтения регистров блока копируют значения из образа, признаки достоверности и 
+// возраст значений рассчитываются на момент чтения, КС ответа на чтение всего блока
+// исправляется по измененным регистрам. Поток читающий образ никогда не ожидает 
+// завершения записи, см. ImageRead()
+// uint8_t meter - индекс счетчика
+// Вызов из потока опроса счетчика после публикации значений
+//*****************************************************************************************
+void ModbusImage( uint8_t meter ) {
+
+    uint8_t idx;
+    uint32_t seq;
+    REG_IMAGE *image;
+
+    if ( meter >= MERC_DEV_MAX )
+        return;
+    seq = image_seq[meter] + 1;
+    image = &meter_image[meter][seq & 0x01];
+    image->words = GlbParamGet( GLB_MBUS_WORDS, GLB_PARAM_VALUE );
+    image->answ.dev_addr = GlbParamGet( GLB_MBUS_ID, GLB_PARAM_VALUE );
+    image->answ.function = FUNC_RD_HOLD_REG;
+    image->answ.cnt_byte = GetRegister( image->answ.data_reg, &reg_block[REG_BLOCK_METER], meter, 0, MB_METER_MAX );
+    for ( idx = 0; idx < MB_METER_MAX; idx++ )
+        Swap16( &image->answ.data_reg[idx] );
+    image->answ.data_reg[MB_METER_MAX] = CalcCRC16( (uint8_t *)&image->answ, image->answ.cnt_byte + 3 );
+    //образ сформирован до переключения буфера
+    __DMB();
+    image_seq[meter] = seq;
+ }
+
 //*****************************************************************************************
 // Проверяем правильность фрейма запроса
+// КС и адрес уст-ва проверены при приеме, см. Thread485Recv()
 // char *data     - указатель на данные 
 // uint8_t len    - размер принятых данных
 // return = true  - запрос проверен
-//          false - запрос не нам, КС не совпала
+//          false - размер фрейма не соответствует запросу
 // Вызов из Thread485Recv()
 //*****************************************************************************************
 bool CheckFrame( uint8_t *data, uint8_t len ) {
 
     uint8_t func;
-    uint16_t crc_calc, crc_data;
 
-    if ( data == NULL || len < 8 )
+    if ( data == NULL || len < 4 )
         return false; //кол-во принятых данных не соответствут размеру запроса
-    //проверим КС
-    crc_calc = CalcCRC16( data, len - 2 );
-    crc_data = *((uint16_t*)( data + len - 2 ));
-    if ( crc_calc != crc_data )
-        return false; //КС не совпали
-    if ( *data != GlbParamGet( GLB_MBUS_ID, GLB_PARAM_VALUE ) )
-        return false; //фрейм не для нас
     func = *( data + 1 );
-    if ( func != FUNC_RD_HOLD_REG ) {
-        //запрос не поддерживаемой функции, доступные функции: 0x03, 0x06, 0x10
-        //формируем ответ с ошибкой
-        answ_error.dev_addr = GlbParamGet( GLB_MBUS_ID, GLB_PARAM_VALUE );
-        answ_error.function = func | FUNC_ANSWER_ERROR;
-        answ_error.error = MB_ERROR_CRC;
-        answ_error.crc = CalcCRC16( (uint8_t *)&answ_error, sizeof( answ_error ) - 2 );
-        RS485Send( (uint8_t *)&answ_error, sizeof( answ_error ) );
+    if ( func == FUNC_DIAGNOSTIC ) {
+        //диагностика линии, значения счетчиков потока приема
+        Diagnostic( data, len );
+        return true;
        }
+    if ( func == FUNC_DEV_IDENT ) {
+        //идентификация уст-ва
+        DeviceIdent( data, len );
+        return true;
+       }
+    if ( func == FUNC_RD_FIFO ) {
+        //последние выборки истории мгновенных значений
+        ReadFifo( data, len );
+        return true;
+       }
+    if ( len < 8 )
+        return false; //кол-во принятых данных не соответствут размеру запроса
+    if ( func != FUNC_RD_HOLD_REG && func != FUNC_WR_SING_REG && func != FUNC_WR_MULT_REG ) {
+        //запрос не поддерживаемой функции, доступные функции: 0x03, 0x06, 0x08, 0x10, 0x18, 0x2B
+        AnswError( func, MB_ERROR_CRC );
+        return true;
+       }
+    if ( ( func == FUNC_RD_HOLD_REG || func == FUNC_WR_SING_REG ) && len != 8 )
+        return false; //размер запросов 0x03, 0x06 фиксированный
     //обработаем принятый фрейм для дальнейшей проверки
     if ( func == FUNC_RD_HOLD_REG ) {
         //чтение значений из нескольких регистров хранения
@@ -104,6 +519,27 @@ bool CheckFrame( uint8_t *data, uint8_t len ) {
         Swap16( &req_rd_reg.cnt_reg );
         CrtFrame( req_rd_reg.function, req_rd_reg.addr_reg, req_rd_reg.cnt_reg, NULL );  
        } 
+    if ( func == FUNC_WR_SING_REG ) {
+        //запись значения одного регистра хранения
+        memset( &wr_reg, 0x00, sizeof( wr_reg ) );
+        memcpy( &wr_reg, data, sizeof( wr_reg ) );
+        Swap16( &wr_reg.addr_reg );
+        CrtFrame( wr_reg.function, wr_reg.addr_reg, 1, data + 4 );  
+       } 
+    if ( func == FUNC_WR_MULT_REG ) {
+        //запись значений нескольких регистров хранения
+        memset( &req_wr_regs, 0x00, sizeof( req_wr_regs ) );
+        memcpy( &req_wr_regs, data, sizeof( req_wr_regs ) );
+        Swap16( &req_wr_regs.addr_reg );
+        Swap16( &req_wr_regs.cnt_reg );
+        if ( !req_wr_regs.cnt_reg || req_wr_regs.cnt_reg > MB_REG_WR_MAX || req_wr_regs.cnt_byte != req_wr_regs.cnt_reg * 2 ||
+             len != sizeof( req_wr_regs ) + req_wr_regs.cnt_byte + MAX_DATA_CRC ) {
+            //размер данных не соответствует кол-ву регистров
+            AnswError( func, MB_ERROR_VALUE );
+            return true;
+           }
+        CrtFrame( req_wr_regs.function, req_wr_regs.addr_reg, req_wr_regs.cnt_reg, data + sizeof( req_wr_regs ) );  
+       } 
     return true;
  }
 
@@ -112,27 +548,46 @@ bool CheckFrame( uint8_t *data, uint8_t len ) {
 // uint8_t func       - код функции  
 // uint16_t adr_reg   - адрес регистра   
 // uint16_t cnt_reg   - кол-во регистров  
-// uint16_t *data_reg - указатель на значения регистров 
+// uint8_t *data_reg  - указатель на значения регистров в запросе (старший байт первым), 
+//                      только для FUNC_WR_SING_REG, FUNC_WR_MULT_REG
 //*****************************************************************************************
-static bool CrtFrame( uint8_t func, uint16_t adr_reg, uint16_t cnt_reg, uint16_t *data_reg ) {
+static bool CrtFrame( uint8_t func, uint16_t adr_reg, uint16_t cnt_reg, uint8_t *data_reg ) {
 
-    uint16_t crc;
-    uint8_t idx, error = 0;
+    uint16_t crc, offset;
+    uint8_t idx, meter, dev_addr, error = 0;
+    const REG_BLOCK *block;
     
+    block = FindBlock( adr_reg, cnt_reg, &meter, &offset );
     //проверка исходных параметров
-    if ( func == FUNC_RD_HOLD_REG && ( adr_reg >= EXMER_REG_RD_MAX || ( adr_reg + cnt_reg ) > EXMER_REG_RD_MAX ) && !error ) {
+    if ( func == FUNC_RD_HOLD_REG && ( !cnt_reg || cnt_reg > MB_REG_RD_MAX ) && !error ) {
+        //недопустимое кол-во регистров чтения
+        error = MB_ERROR_VALUE;
+        func |= FUNC_ANSWER_ERROR;
+       }   
+    if ( func == FUNC_RD_HOLD_REG && ( block == NULL || !CheckAccess( block, offset, cnt_reg, MB_ACCESS_RD ) ) && !error ) {
         //чтение значений из нескольких регистров хранения
         error = MB_ERROR_ADDR; //выход за пределы адресов регистров чтения
         func |= FUNC_ANSWER_ERROR;
        }   
+    if ( ( func == FUNC_WR_SING_REG || func == FUNC_WR_MULT_REG ) && ( block == NULL || block->set == NULL || 
+         !CheckAccess( block, offset, cnt_reg, MB_ACCESS_WR ) ) && !error ) {
+        //запись доступна только для блоков с функцией записи: параметры, диагностика
+        error = MB_ERROR_ADDR;
+        func |= FUNC_ANSWER_ERROR;
+       }   
     //выполнение функции
+    if ( func == FUNC_RD_HOLD_REG && !error && block == &reg_block[REG_BLOCK_METER] && ImageRead( meter, offset, cnt_reg ) ) {
+        //значения регистров из образа, сформированного потоком опроса счетчика
+        RS485Send( (uint8_t *)&rd_regs, rd_regs.cnt_byte + 3 + 2 ); 
+        return true;
+       }  
     if ( func == FUNC_RD_HOLD_REG && !error ) {
         //чтение значений из нескольких регистров хранения
         memset( (uint8_t *)&rd_regs, 0x00, sizeof( rd_regs ) );
         rd_regs.dev_addr = GlbParamGet( GLB_MBUS_ID, GLB_PARAM_VALUE );
         rd_regs.function = func;
         //запишем значения запрашиваемых регистров в массив
-        rd_regs.cnt_byte = GetRegister( rd_regs.data_reg, adr_reg, cnt_reg );
+        rd_regs.cnt_byte = GetRegister( rd_regs.data_reg, block, meter, offset, cnt_reg );
         //поменяем байты местами для переменных uint16_t, т.к. сначала передаем старший байт
         for ( idx = 0; idx < cnt_reg; idx++ )
             Swap16( &rd_regs.data_reg[idx] );
@@ -142,82 +597,736 @@ static bool CrtFrame( uint8_t func, uint16_t adr_reg, uint16_t cnt_reg, uint16_t
         RS485Send( (uint8_t *)&rd_regs, rd_regs.cnt_byte + 3 + 2 ); 
         return true;
        }  
+    if ( ( func == FUNC_WR_SING_REG || func == FUNC_WR_MULT_REG ) && !error ) {
+        //запись значений регистров, ответ передаем с номером уст-ва из запроса,
+        //даже если запрос изменил номер уст-ва в сети ModBus
+        dev_addr = GlbParamGet( GLB_MBUS_ID, GLB_PARAM_VALUE );
+        error = block->set( block, offset, cnt_reg, data_reg );
+        if ( error )
+            func |= FUNC_ANSWER_ERROR;
+        else {
+            //ответ повторяет запрос: адрес регистра и значение (0x06) или кол-во регистров (0x10)
+            memset( (uint8_t *)&wr_reg, 0x00, sizeof( wr_reg ) );
+            wr_reg.dev_addr = dev_addr;
+            wr_reg.function = func;
+            wr_reg.addr_reg = adr_reg;
+            if ( func == FUNC_WR_SING_REG )
+                wr_reg.value = ( *data_reg << 8 ) | *( data_reg + 1 );
+            else wr_reg.value = cnt_reg;
+            Swap16( &wr_reg.addr_reg );
+            Swap16( &wr_reg.value );
+            wr_reg.crc = CalcCRC16( (uint8_t *)&wr_reg, sizeof( wr_reg ) - 2 );
+            RS485Send( (uint8_t *)&wr_reg, sizeof( wr_reg ) );
+            return true;
+           }
+       }  
     if ( func & FUNC_ANSWER_ERROR ) {
         //формируем ответ с ошибкой
-        answ_error.dev_addr = GlbParamGet( GLB_MBUS_ID, GLB_PARAM_VALUE );
-        answ_error.function = func;
-        answ_error.error = error;
-        answ_error.crc = CalcCRC16( (uint8_t *)&answ_error, sizeof( answ_error ) - 2 );
-        RS485Send( (uint8_t *)&answ_error, sizeof( answ_error ) );
+        AnswError( func, error );
         return true;
        }
     return false; 
  }
- 
+
 //*****************************************************************************************
-// Заполняем блок памяти значениями регистров
-// uint16_t *data   - адрес памяти для размещения данных 
-// uint16_t adr_reg - адрес регистра 
-// uint16_t cnt_reg - кол-во регистров
-// return           - кол-во записанных байт  
+// Диагностика линии (0x08): возврат данных запроса, значения и сброс счетчиков линии
+// char *data  - указатель на данные запроса
+// uint8_t len - размер запроса
 //*****************************************************************************************
-static uint8_t GetRegister( uint16_t *data, uint16_t adr_reg, uint16_t cnt_reg ) {
+static void Diagnostic( uint8_t *data, uint8_t len ) {
 
-    uint8_t bytes = 0;
-    
-    //регистр текущего источника сброса контроллера
-    if ( adr_reg == EXMER_REG_RD_STAT && cnt_reg ) {
-        bytes += 2;
-        *data = StatReset();
-        if ( cnt_reg-- ) {
-            data++;
-            adr_reg++;
+    uint8_t idx;
+    uint16_t sub_func;
+
+    if ( len < 8 || ( len & 0x01 ) ) {
+        //данные подфункции - целое кол-во слов
+        AnswError( FUNC_DIAGNOSTIC, MB_ERROR_VALUE );
+        return;
+       }
+    sub_func = ( *( data + 2 ) << 8 ) | *( data + 3 );
+    if ( sub_func == DIAG_RET_QUERY ) {
+        //ответ повторяет запрос вместе с КС
+        memcpy( answ_buff, data, len );
+        RS485Send( answ_buff, len );
+        return;
+       }
+    for ( idx = 0; idx < sizeof( diag_count ) / sizeof( diag_count[0] ); idx++ ) {
+        if ( diag_count[idx][0] == sub_func )
+            break;
+       }
+    if ( sub_func != DIAG_CLR_COUNTERS && idx == sizeof( diag_count ) / sizeof( diag_count[0] ) ) {
+        AnswError( FUNC_DIAGNOSTIC, MB_ERROR_CRC ); //подфункция не поддерживается
+        return;
+       }
+    if ( len != 8 || *( data + 4 ) || *( data + 5 ) ) {
+        //поле данных подфункций счетчиков - 0x0000
+        AnswError( FUNC_DIAGNOSTIC, MB_ERROR_VALUE );
+        return;
+       }
+    if ( sub_func == DIAG_CLR_COUNTERS ) {
+        //ответ повторяет запрос
+        RS485CountReset();
+        memcpy( answ_buff, data, len );
+        RS485Send( answ_buff, len );
+        return;
+       }
+    answ_diag.dev_addr = *data;
+    answ_diag.function = FUNC_DIAGNOSTIC;
+    answ_diag.sub_func = sub_func;
+    answ_diag.value = RS485Count( diag_count[idx][1] );
+    Swap16( &answ_diag.sub_func );
+    Swap16( &answ_diag.value );
+    answ_diag.crc = CalcCRC16( (uint8_t *)&answ_diag, sizeof( answ_diag ) - 2 );
+    RS485Send( (uint8_t *)&answ_diag, sizeof( answ_diag ) );
+ }
+
+//*****************************************************************************************
+// Чтение идентификации уст-ва (0x2B/0x0E), значения объектов формируются из параметров 
+// и атрибутов счетчиков без обращения к потоку опроса счетчиков
+// char *data  - указатель на данные запроса: адрес, функция, тип MEI, код чтения, объект
+// uint8_t len - размер запроса
+//*****************************************************************************************
+static void DeviceIdent( uint8_t *data, uint8_t len ) {
+
+    int size;
+    uint8_t code, obj, last, cnt = 0;
+    uint16_t pos;
+    char value[DEVID_VALUE_MAX];
+
+    if ( len != 7 ) {
+        AnswError( FUNC_DEV_IDENT, MB_ERROR_VALUE );
+        return;
+       }
+    if ( *( data + 2 ) != MEI_DEV_IDENT ) {
+        AnswError( FUNC_DEV_IDENT, MB_ERROR_CRC ); //тип MEI не поддерживается
+        return;
+       }
+    code = *( data + 3 );
+    obj = *( data + 4 );
+    if ( code < DEVID_BASIC || code > DEVID_SPECIFIC ) {
+        AnswError( FUNC_DEV_IDENT, MB_ERROR_VALUE );
+        return;
+       }
+    if ( DevIdentValue( obj, NULL ) < 0 ) {
+        //объект не существует: для чтения одного объекта - ошибка, 
+        //для потокового чтения - чтение с первого объекта
+        if ( code == DEVID_SPECIFIC ) {
+            AnswError( FUNC_DEV_IDENT, MB_ERROR_ADDR );
+            return;
            }
+        obj = DEVID_VENDOR;
        }
-    //регистр мгновенного значения тока
-    if ( adr_reg == EXMER_REG_RD_CURRENT && cnt_reg ) {
-        bytes += 2;
-        *data = GetData( INSTVAL_CURRENT );
-        if ( cnt_reg-- ) {
-            data++;
-            adr_reg++;
+    if ( code == DEVID_SPECIFIC )
+        last = obj;
+    else if ( code == DEVID_BASIC )
+        last = DEVID_REVISION;
+    else if ( code == DEVID_REGULAR )
+        last = DEVID_METER - 1;
+    else last = UINT8_MAX;
+    answ_buff[0] = *data;
+    answ_buff[1] = FUNC_DEV_IDENT;
+    answ_buff[2] = MEI_DEV_IDENT;
+    answ_buff[3] = code;
+    answ_buff[4] = DEVID_CONFORMITY;
+    answ_buff[5] = 0x00;                    //последний фрейм ответа
+    answ_buff[6] = 0x00;                    //следующий объект
+    pos = 8;
+    while ( obj <= last ) {
+        //значение объекта: код, размер, строка без завершающего нуля, 
+        //объекты, не поместившиеся в фрейм, передаются в следующем ответе
+        size = DevIdentValue( obj, value );
+        if ( size >= 0 ) {
+            if ( pos + 2 + size > sizeof( answ_buff ) - MAX_DATA_CRC ) {
+                answ_buff[5] = 0xFF;
+                answ_buff[6] = obj;
+                break;
+               }
+            answ_buff[pos] = obj;
+            answ_buff[pos + 1] = size;
+            memcpy( answ_buff + pos + 2, value, size );
+            pos += 2 + size;
+            cnt++;
            }
+        if ( obj == UINT8_MAX )
+            break;
+        obj++;
        }
-    //регистр мгновенного значения напряжения
-    if ( adr_reg == EXMER_REG_RD_VOLTAGE && cnt_reg ) {
-        bytes += 2;
-        *data = GetData( INSTVAL_VOLTAGE );
-        if ( cnt_reg-- ) {
-            data++;
-            adr_reg++;
+    answ_buff[7] = cnt;
+    *( (uint16_t *)( answ_buff + pos ) ) = CalcCRC16( answ_buff, pos );
+    RS485Send( answ_buff, pos + MAX_DATA_CRC );
+ }
+
+//*****************************************************************************************
+// Значение объекта идентификации уст-ва
+// uint8_t id - код объекта
+// char *str  - адрес для размещения строки (DEVID_VALUE_MAX байт), NULL - только проверка наличия объекта
+// return     - размер строки, -1 - объект не существует
+//*****************************************************************************************
+static int DevIdentValue( uint8_t id, char *str ) {
+
+    uint8_t meter;
+    uint32_t attr;
+
+    if ( id <= DEVID_REVISION ) {
+        if ( str != NULL )
+            strcpy( str, dev_ident[id] );
+        return strlen( dev_ident[id] );
+       }
+    if ( id < DEVID_METER )
+        return -1;
+    meter = ( id - DEVID_METER ) / 2;
+    if ( meter >= GlbParamGet( GLB_MERCURY_CNT, GLB_PARAM_VALUE ) )
+        return -1;
+    if ( str == NULL )
+        return 0;
+    *str = '\0';
+    //атрибут еще не прочитан из счетчика - пустая строка
+    if ( !( id & 0x01 ) && ( GetAttrValid( meter ) & ATTR_SERIALNUM ) )
+        sprintf( str, "%lu", (unsigned long)GetAttr( meter, ATTR_SERIALNUM ) );
+    if ( ( id & 0x01 ) && ( GetAttrValid( meter ) & ATTR_VERSION ) ) {
+        attr = GetAttr( meter, ATTR_VERSION );
+        sprintf( str, "%u.%u.%u", (unsigned)( attr >> 16 ) & 0xFF, (unsigned)( attr >> 8 ) & 0xFF, (unsigned)attr & 0xFF );
+       }
+    return strlen( str );
+ }
+
+//*****************************************************************************************
+// Чтение очереди FIFO (0x18): последние MB_FIFO_REC_CNT выборок истории в порядке
+// возрастания номеров, формат выборки см. MB_HIST_WINDOW
+// char *data  - указатель на данные запроса: адрес, функция, адрес очереди
+// uint8_t len - размер запроса
+//*****************************************************************************************
+static void ReadFifo( uint8_t *data, uint8_t len ) {
+
+    uint8_t cnt, idx, rec;
+    uint16_t pos, value;
+    uint32_t first, last;
+
+    if ( len != 6 ) {
+        AnswError( FUNC_RD_FIFO, MB_ERROR_VALUE );
+        return;
+       }
+    if ( ( ( *( data + 2 ) << 8 ) | *( data + 3 ) ) != MB_REG_HIST_BASE ) {
+        AnswError( FUNC_RD_FIFO, MB_ERROR_ADDR );
+        return;
+       }
+    HistRange( &first, &last );
+    cnt = HistRead( last > MB_FIFO_REC_CNT ? last - MB_FIFO_REC_CNT : 0, hist_buff, MB_FIFO_REC_CNT );
+    answ_buff[0] = *data;
+    answ_buff[1] = FUNC_RD_FIFO;
+    value = 2 + cnt * MB_HIST_REC_SIZE * 2; //кол-во байт: кол-во регистров в очереди + значения
+    answ_buff[2] = value >> 8;
+    answ_buff[3] = value & 0xFF;
+    value = cnt * MB_HIST_REC_SIZE;         //кол-во регистров в очереди
+    answ_buff[4] = value >> 8;
+    answ_buff[5] = value & 0xFF;
+    pos = 6;
+    for ( rec = 0; rec < cnt; rec++ ) {
+        for ( idx = 0; idx < MB_HIST_REC_SIZE; idx++ ) {
+            value = HistValue( &hist_buff[rec], idx );
+            answ_buff[pos++] = value >> 8;
+            answ_buff[pos++] = value & 0xFF;
+           }
+       }
+    *( (uint16_t *)( answ_buff + pos ) ) = CalcCRC16( answ_buff, pos );
+    RS485Send( answ_buff, pos + MAX_DATA_CRC );
+ }
+
+//*****************************************************************************************
+// Формирование и передача ответа с ошибкой
+// uint8_t func  - код функции запроса
+// uint8_t error - код ошибки
+//*****************************************************************************************
+static void AnswError( uint8_t func, uint8_t error ) {
+
+    answ_error.dev_addr = GlbParamGet( GLB_MBUS_ID, GLB_PARAM_VALUE );
+    answ_error.function = func | FUNC_ANSWER_ERROR;
+    answ_error.error = error;
+    answ_error.crc = CalcCRC16( (uint8_t *)&answ_error, sizeof( answ_error ) - 2 );
+    RS485Send( (uint8_t *)&answ_error, sizeof( answ_error ) );
+ }
+ 
+//*****************************************************************************************
+// Поиск блока, содержащего весь диапазон регистров
+// uint16_t adr_reg - адрес первого регистра
+// uint16_t cnt_reg - кол-во регистров
+// uint8_t *meter   - индекс счетчика для блоков счетчиков, иначе 0
+// uint16_t *offset - смещение первого регистра в блоке
+// return           - указатель на описание блока, NULL - регистры не найдены
+//*****************************************************************************************
+static const REG_BLOCK *FindBlock( uint16_t adr_reg, uint16_t cnt_reg, uint8_t *meter, uint16_t *offset ) {
+
+    uint8_t idx;
+    const REG_BLOCK *block;
+
+    if ( !cnt_reg )
+        return NULL;
+    for ( idx = 0; idx < sizeof( reg_block ) / sizeof( REG_BLOCK ); idx++ ) {
+        block = &reg_block[idx];
+        if ( adr_reg < block->base )
+            continue;
+        *meter = 0;
+        *offset = adr_reg - block->base;
+        if ( block->meter == true ) {
+            //блок подключенного счетчика
+            *meter = *offset / MB_REG_METER_SIZE;
+            *offset %= MB_REG_METER_SIZE;
+            if ( *meter >= GlbParamGet( GLB_MERCURY_CNT, GLB_PARAM_VALUE ) )
+                continue;
            }
+        if ( *offset + cnt_reg > block->cnt )
+            continue;
+        return block;
+       }
+    return NULL;
+ }
+
+//*****************************************************************************************
+// Проверка прав доступа ко всем регистрам диапазона, неиспользуемые регистры не проверяются
+// const REG_BLOCK *block - описание блока регистров
+// uint16_t offset        - смещение первого регистра в блоке
+// uint16_t cnt_reg       - кол-во регистров
+// uint8_t access         - требуемый доступ, см. MB_ACCESS_*
+// return = true          - доступ разрешен
+//*****************************************************************************************
+static bool CheckAccess( const REG_BLOCK *block, uint16_t offset, uint16_t cnt_reg, uint8_t access ) {
+
+    const REG_DESC *desc;
+
+    if ( block->desc == NULL )
+        return access == MB_ACCESS_RD || block->set != NULL; //регистры записи проверяет функция записи блока
+    for ( desc = &block->desc[offset]; cnt_reg; cnt_reg--, desc++ ) {
+        if ( desc->get != NULL && !( desc->access & access ) )
+            return false;
+       }
+    return true;
+ }
+
+//*****************************************************************************************
+// Заполняем блок памяти значениями регистров блока, один проход по описаниям регистров
+// uint16_t *data         - адрес памяти для размещения данных 
+// const REG_BLOCK *block - описание блока регистров
+// uint8_t meter          - индекс счетчика
+// uint16_t offset        - смещение первого регистра в блоке
+// uint16_t cnt_reg       - кол-во регистров
+// return                 - кол-во записанных байт  
+//*****************************************************************************************
+static uint8_t GetRegister( uint16_t *data, const REG_BLOCK *block, uint8_t meter, uint16_t offset, uint16_t cnt_reg ) {
+
+    float fvalue;
+    uint32_t value;
+    uint8_t bytes = 0, words;
+    const REG_DESC *desc;
+    MERC_VALUES values;
+
+    if ( block == &reg_block[REG_BLOCK_HIST] )
+        return HistRegister( data, offset, cnt_reg );
+    if ( block->desc == NULL ) {
+        //значения регистров вычисляются по смещению
+        for ( ; cnt_reg; cnt_reg--, offset++, data++, bytes += 2 )
+            *data = block->get( meter, offset );
+        return bytes;
        }
-    //регистр мгновенного значения потребляемой мощности
-    if ( adr_reg == EXMER_REG_RD_POWER && cnt_reg ) {
-        bytes += 2;
-        *data = GetData( INSTVAL_POWER );
-        if ( cnt_reg-- ) {
-            data++;
-            adr_reg++;
+    //все значения ответа из одного цикла опроса счетчика, 
+    //оба регистра 32-битного значения всегда из одного снимка
+    GetSnapshot( meter, &values );
+    words = GlbParamGet( GLB_MBUS_WORDS, GLB_PARAM_VALUE );
+    for ( desc = &block->desc[offset]; cnt_reg; cnt_reg--, desc++, data++, bytes += 2 ) {
+        if ( desc->get == NULL ) {
+            *data = 0;
+            continue;
+           }
+        value = desc->get( meter, &values, desc );
+        if ( desc->flags & REG_FLOAT ) {
+            //передаем значение в единицах измерения
+            fvalue = (float)value / desc->scale;
+            memcpy( &value, &fvalue, sizeof( value ) );
            }
+        else if ( desc->scale > 1 )
+            value /= desc->scale;
+        if ( desc->width != 2 ) {
+            *data = value;
+            continue;
+           }
+        //32-битное значение: старшее слово первым, если не задан другой порядок
+        if ( ( desc->flags & REG_WORDS ) && words == MBUS_WORDS_LOW_FIRST )
+            *data = desc->index ? value >> 16 : value & 0xFFFF;
+        else *data = desc->index ? value & 0xFFFF : value >> 16;
        }
-    //регистр значения накопленной мощности дневного тарифа
-    if ( adr_reg == EXMER_REG_RD_TARIFF1 && cnt_reg ) {
-        bytes += 2;
-        *data = (uint16_t)GetData( INSTVAL_TARIFF1 );
-        if ( cnt_reg-- ) {
-            data++;
-            adr_reg++;
+    return bytes;
+ }
+
+//*****************************************************************************************
+// Формирование ответа на чтение регистров блока данных счетчика из образа регистров
+// Ответ на чтение всего блока копируется вместе с КС, для части блока КС рассчитывается.
+// Признаки достоверности и возраст значений меняются без опроса счетчика (счетчик не отвечает,
+// опрос отложен), регистры MB_METER_QUALITY - MB_METER_AGE_TARIFF заменяются значениями 
+// на момент чтения, как при чтении через GetRegister(), КС ответа на чтение всего блока
+// исправляется по разности значений этих регистров, см. CRC16Patch()
+// uint8_t meter    - индекс счетчика
+// uint16_t offset  - смещение первого регистра в блоке
+// uint16_t cnt_reg - кол-во регистров
+// return = true    - ответ сформирован в rd_regs
+//          false   - образ не сформирован или сформирован с другими параметрами ModBus
+//*****************************************************************************************
+static bool ImageRead( uint8_t meter, uint16_t offset, uint16_t cnt_reg ) {
+
+    uint8_t idx;
+    uint32_t seq;
+    bool full;
+    uint16_t value, delta[MB_METER_AGE_TARIFF - MB_METER_QUALITY + 1];
+    REG_IMAGE *image;
+    MERC_VALUES values;
+
+    full = ( !offset && cnt_reg == MB_METER_MAX );
+    //копирование повторяется, если во время копирования поток опроса начал запись в этот же буфер
+    do {
+        seq = image_seq[meter];
+        __DMB();
+        image = &meter_image[meter][seq & 0x01];
+        if ( !seq || image->words != GlbParamGet( GLB_MBUS_WORDS, GLB_PARAM_VALUE ) || 
+             image->answ.dev_addr != GlbParamGet( GLB_MBUS_ID, GLB_PARAM_VALUE ) )
+            return false;
+        if ( full == true )
+            memcpy( (uint8_t *)&rd_regs, (uint8_t *)&image->answ, sizeof( image->answ ) );
+        else memcpy( (uint8_t *)rd_regs.data_reg, (uint8_t *)&image->answ.data_reg[offset], cnt_reg * 2 );
+        __DMB();
+       } while ( seq != image_seq[meter] );
+    //признаки достоверности и возраст значений на момент чтения
+    if ( offset <= MB_METER_AGE_TARIFF && offset + cnt_reg > MB_METER_QUALITY ) {
+        GetSnapshot( meter, &values );
+        for ( idx = MB_METER_QUALITY; idx <= MB_METER_AGE_TARIFF; idx++ ) {
+            if ( idx < offset || idx >= offset + cnt_reg )
+                continue;
+            value = RegValue( meter, &values, &meter_desc[idx] );
+            Swap16( &value );
+            delta[idx - MB_METER_QUALITY] = rd_regs.data_reg[idx - offset] ^ value;
+            rd_regs.data_reg[idx - offset] = value;
            }
        }
-    //регистр значения накопленной мощности ночного тарифа
-    if ( adr_reg == EXMER_REG_RD_TARIFF2 && cnt_reg ) {
-        bytes += 2;
-        *data = (uint16_t)GetData( INSTVAL_TARIFF2 );
+    if ( full == true ) {
+        rd_regs.data_reg[MB_METER_MAX] = CRC16Patch( rd_regs.data_reg[MB_METER_MAX], (uint8_t *)delta, sizeof( delta ), image_shift );
+        return true;
+       }
+    rd_regs.dev_addr = image->answ.dev_addr;
+    rd_regs.function = FUNC_RD_HOLD_REG;
+    rd_regs.cnt_byte = cnt_reg * 2;
+    rd_regs.data_reg[cnt_reg] = CalcCRC16( (uint8_t *)&rd_regs, rd_regs.cnt_byte + 3 );
+    return true;
+ }
+
+//*****************************************************************************************
+// Значение счетчика из снимка значений
+// const MERC_VALUES *values - снимок значений счетчика
+// const REG_DESC *desc      - описание регистра, arg - код значения, см. VAL_*
+//*****************************************************************************************
+static uint32_t RegValue( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc ) {
+
+    switch ( desc->arg ) {
+        case VAL_LINK:       return values->stat_link;
+        case VAL_VOLTAGE:    return values->voltage;
+        case VAL_CURRENT:    return values->current;
+        case VAL_POWER:      return values->power;
+        case VAL_TARIFF1:    return values->tariff1;
+        case VAL_TARIFF2:    return values->tariff2;
+        case VAL_QUALITY:    return values->quality;
+        case VAL_AGE_INST:   return values->age_inst;
+        case VAL_AGE_TARIFF: return values->age_tariff;
+       }
+    return 0;
+ }
+
+//*****************************************************************************************
+// Текущий источник сброса контроллера
+//*****************************************************************************************
+static uint32_t RegReset( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc ) {
+
+    return StatReset();
+ }
+
+//*****************************************************************************************
+// Маска прочитанных атрибутов счетчика
+//*****************************************************************************************
+static uint32_t RegAttrValid( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc ) {
+
+    return GetAttrValid( meter );
+ }
+
+//*****************************************************************************************
+// Значение атрибута счетчика, arg - код атрибута, см. ATTR_*
+//*****************************************************************************************
+static uint32_t RegAttr( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc ) {
+
+    return GetAttr( meter, desc->arg );
+ }
+
+//*****************************************************************************************
+// Версия ПО счетчика: старшее слово - байт1 << 8 | байт2, младшее слово - байт3
+//*****************************************************************************************
+static uint32_t RegVersion( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc ) {
+
+    uint32_t value;
+
+    value = GetAttr( meter, desc->arg );
+    return ( ( value >> 8 ) << 16 ) | ( value & 0xFF );
+ }
+
+//*****************************************************************************************
+// Дата атрибута счетчика: старшее слово - год, младшее слово - месяц << 8 | день
+//*****************************************************************************************
+static uint32_t RegDate( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc ) {
+
+    timedate tm;
+
+    GetAttrTime( meter, desc->arg, &tm );
+    return ( TimeValue( &tm, 0 ) << 16 ) | TimeValue( &tm, 1 );
+ }
+
+//*****************************************************************************************
+// Регистр дата/время, index - номер регистра, см. TimeValue()
+// arg - код атрибута счетчика, см. ATTR_*, 0 - часы контроллера
+//*****************************************************************************************
+static uint32_t RegTime( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc ) {
+
+    timedate tm;
+
+    if ( desc->arg )
+        GetAttrTime( meter, desc->arg, &tm );
+    else GetTimeDate( &tm );
+    return TimeValue( &tm, desc->index );
+ }
+
+//*****************************************************************************************
+// Значение параметра настроек, arg - ID параметра, см. GLB_*
+// для скоростей обмена - индекс скорости
+//*****************************************************************************************
+static uint32_t RegParam( uint8_t meter, const MERC_VALUES *values, const REG_DESC *desc ) {
+
+    return GlbParamGet( desc->arg, GLB_PARAM_INDEX );
+ }
+
+//*****************************************************************************************
+// Значение регистра блока статистики обмена счетчика
+// uint8_t meter   - индекс счетчика
+// uint16_t offset - смещение регистра в блоке
+// return          - значение регистра
+//*****************************************************************************************
+static uint16_t StatRegister( uint8_t meter, uint16_t offset ) {
+
+    uint32_t value;
+
+    if ( offset < MB_STAT_LATENCY )
+        value = GetLinkCount( meter, offset / MB_STAT_CMND_SIZE, ( offset % MB_STAT_CMND_SIZE ) / 2 );
+    else value = GetLatency( meter, ( offset - MB_STAT_LATENCY ) / 2 );
+    //четное смещение - старшее слово значения
+    return ( offset & 0x01 ) ? value & 0xFFFF : value >> 16;
+ }
+
+//*****************************************************************************************
+// Значение регистра блока диагностики
+// uint8_t meter   - не используется
+// uint16_t offset - смещение регистра в блоке
+// return          - значение регистра
+//*****************************************************************************************
+static uint16_t DiagRegister( uint8_t meter, uint16_t offset ) {
+
+    uint32_t value;
+
+    if ( offset < MB_DIAG_LATENCY )
+        return 0;
+    if ( offset >= MB_DIAG_LOG )
+        value = DataLogerStat( ( offset - MB_DIAG_LOG ) / 2 );
+    else value = RS485Latency( ( offset - MB_DIAG_LATENCY ) / MB_DIAG_FUNC_SIZE, ( ( offset - MB_DIAG_LATENCY ) % MB_DIAG_FUNC_SIZE ) / 2 );
+    //четное смещение - старшее слово значения
+    return ( offset & 0x01 ) ? value & 0xFFFF : value >> 16;
+ }
+
+//*****************************************************************************************
+// Запись регистров блока диагностики, доступен только регистр сброса статистики
+// const REG_BLOCK *block - описание блока регистров
+// uint16_t offset        - смещение первого регистра в блоке
+// uint16_t cnt_reg       - кол-во регистров
+// uint8_t *data          - значения регистров (старший байт первым)
+// return                 - код ошибки MODBUS, 0 - запись выполнена
+//*****************************************************************************************
+static uint8_t SetDiagRegister( const REG_BLOCK *block, uint16_t offset, uint16_t cnt_reg, uint8_t *data ) {
+
+    if ( offset != MB_DIAG_RESET || cnt_reg != 1 )
+        return MB_ERROR_ADDR;
+    RS485LatencyReset();
+    return 0;
+ }
+
+//*****************************************************************************************
+// Значения регистров блока истории, выборки окна читаются из истории один раз для запроса
+// uint16_t *data   - адрес памяти для размещения данных 
+// uint16_t offset  - смещение первого регистра в блоке
+// uint16_t cnt_reg - кол-во регистров
+// return           - кол-во записанных байт  
+//*****************************************************************************************
+static uint8_t HistRegister( uint16_t *data, uint16_t offset, uint16_t cnt_reg ) {
+
+    uint8_t cnt = 0, rec, bytes = 0;
+    uint32_t first, last, value;
+
+    HistRange( &first, &last );
+    if ( offset + cnt_reg > MB_HIST_WINDOW )
+        cnt = HistRead( hist_cursor, hist_buff, MB_HIST_REC_CNT );
+    for ( ; cnt_reg; cnt_reg--, offset++, data++, bytes += 2 ) {
+        if ( offset >= MB_HIST_WINDOW ) {
+            rec = ( offset - MB_HIST_WINDOW ) / MB_HIST_REC_SIZE;
+            *data = rec < cnt ? HistValue( &hist_buff[rec], ( offset - MB_HIST_WINDOW ) % MB_HIST_REC_SIZE ) : 0;
+            continue;
+           }
+        if ( offset == MB_HIST_COUNT ) {
+            //выборки, перезаписанные после курсора, не учитываются
+            value = last - ( hist_cursor >= first ? hist_cursor : first - 1 );
+            *data = hist_cursor >= last ? 0 : ( value > UINT16_MAX ? UINT16_MAX : value );
+            continue;
+           }
+        if ( offset < MB_HIST_LAST )
+            value = hist_cursor;
+        else if ( offset < MB_HIST_FIRST )
+            value = last;
+        else if ( offset < MB_HIST_COUNT )
+            value = last ? first : 0;
+        else value = 0;
+        //четное смещение - старшее слово значения
+        *data = ( offset & 0x01 ) ? value & 0xFFFF : value >> 16;
        }
     return bytes;
  }
 
+//*****************************************************************************************
+// Значение регистра выборки истории
+// const HIST_SAMPLE *sample - выборка
+// uint8_t index             - номер регистра выборки (0 - MB_HIST_REC_SIZE-1), см. MB_HIST_WINDOW
+//*****************************************************************************************
+static uint16_t HistValue( const HIST_SAMPLE *sample, uint8_t index ) {
+
+    switch ( index ) {
+        case 0: return sample->seq >> 16;
+        case 1: return sample->seq & 0xFFFF;
+        case 2: return sample->time >> 16;
+        case 3: return sample->time & 0xFFFF;
+        case 4: return ( sample->meter << 8 ) | sample->quality;
+        case 5: return sample->voltage;
+        case 6: return sample->current;
+        case 7: return sample->power;
+       }
+    return 0;
+ }
+
+//*****************************************************************************************
+// Запись регистров блока истории, доступен только курсор (2 регистра, функция 0x10)
+// const REG_BLOCK *block - описание блока регистров
+// uint16_t offset        - смещение первого регистра в блоке
+// uint16_t cnt_reg       - кол-во регистров
+// uint8_t *data          - значения регистров (старший байт первым)
+// return                 - код ошибки MODBUS, 0 - запись выполнена
+//*****************************************************************************************
+static uint8_t SetHistRegister( const REG_BLOCK *block, uint16_t offset, uint16_t cnt_reg, uint8_t *data ) {
+
+    if ( offset != MB_HIST_CURSOR || cnt_reg != 2 )
+        return MB_ERROR_ADDR;
+    hist_cursor = ( (uint32_t)*data << 24 ) | ( (uint32_t)*( data + 1 ) << 16 ) | ( *( data + 2 ) << 8 ) | *( data + 3 );
+    return 0;
+ }
+
+//*****************************************************************************************
+// Значение регистра дата/время
+// timedate *tm  - значение дата/время
+// uint8_t index - номер регистра: 0 - год, 1 - месяц << 8 | день, 2 - час << 8 | мин, 3 - сек
+// return        - значение регистра
+//*****************************************************************************************
+static uint16_t TimeValue( timedate *tm, uint8_t index ) {
+
+    if ( index == 0 )
+        return tm->td_year;
+    if ( index == 1 )
+        return ( tm->td_month << 8 ) | tm->td_day;
+    if ( index == 2 )
+        return ( tm->td_hour << 8 ) | tm->td_min;
+    return tm->td_sec;
+ }
+
+//*****************************************************************************************
+// Запись значений регистров блока параметров
+// Новые значения накладываются на текущие значения всех регистров блока, затем проверяются
+// все измененные параметры и только если все значения допустимы параметры изменяются и 
+// сохраняются во FLASH за один цикл стирания/записи, часы устанавливаются один раз.
+// const REG_BLOCK *block - описание блока параметров
+// uint16_t offset        - смещение первого регистра в блоке
+// uint16_t cnt_reg       - кол-во регистров
+// uint8_t *data          - значения регистров из запроса, старший байт первым
+// return = 0             - запись выполнена
+//        > 0             - код ошибки MB_ERROR_*
+//*****************************************************************************************
+static uint8_t SetConfRegister( const REG_BLOCK *block, uint16_t offset, uint16_t cnt_reg, uint8_t *data ) {
+
+    timedate tm;
+    bool change = false, set_time, speed = false;
+    uint8_t idx, last, result;
+    uint32_t value[MB_CONF_MAX];
+    uint16_t regs[MB_CONF_MAX];
+    const REG_DESC *desc;
+
+    last = offset + cnt_reg;
+    //запись затрагивает регистры часов
+    set_time = offset < MB_CONF_DATETIME + 4 && last > MB_CONF_DATETIME;
+    //текущие значения регистров, поверх - значения из запроса
+    GetRegister( regs, block, 0, 0, MB_CONF_MAX );
+    for ( idx = offset; idx < last; idx++, data += 2 )
+        regs[idx] = ( *data << 8 ) | *( data + 1 );
+    //проверка значений измененных параметров, значение описывает первый регистр параметра
+    for ( idx = 0, desc = block->desc; idx < MB_CONF_MAX; idx++, desc++ ) {
+        if ( desc->get != RegParam || desc->index )
+            continue;
+        if ( desc->width == 2 )
+            value[idx] = ( (uint32_t)regs[idx] << 16 ) | regs[idx + 1];
+        else value[idx] = regs[idx];
+        if ( value[idx] == GlbParamGet( desc->arg, GLB_PARAM_INDEX ) )
+            continue;
+        if ( GlbParamCheck( desc->arg, value[idx] ) == false )
+            return MB_ERROR_VALUE;
+        change = true;
+       }
+    if ( set_time == true ) {
+        //проверка значений дата/время
+        tm.td_year = regs[MB_CONF_DATETIME];
+        tm.td_month = regs[MB_CONF_DATETIME + 1] >> 8;
+        tm.td_day = regs[MB_CONF_DATETIME + 1] & 0xFF;
+        tm.td_hour = regs[MB_CONF_DATETIME + 2] >> 8;
+        tm.td_min = regs[MB_CONF_DATETIME + 2] & 0xFF;
+        tm.td_sec = regs[MB_CONF_DATETIME + 3];
+        if ( regs[MB_CONF_DATETIME + 3] > UINT8_MAX || !tm.td_day || !tm.td_month || RTCCheckDate( &tm ) != HAL_OK )
+            return MB_ERROR_VALUE;
+       }
+    //все значения допустимы, изменяем параметры, изменение и запись во FLASH - без вмешательства других потоков
+    if ( change == true ) {
+        GlbParamLock();
+        for ( idx = 0, desc = block->desc; idx < MB_CONF_MAX; idx++, desc++ ) {
+            if ( desc->get != RegParam || desc->index )
+                continue;
+            if ( value[idx] == GlbParamGet( desc->arg, GLB_PARAM_INDEX ) )
+                continue;
+            GlbParamSet( desc->arg, value[idx] );
+            if ( desc->arg == GLB_MERCURY_SPEED )
+                speed = true;
+           }
+        result = GlbParamCommit();
+        GlbParamUnlock();
+        if ( result != HAL_OK )
+            return MB_ERROR_DEVICE;
+        //новая скорость обмена со счетчиком применяется без перезапуска
+        if ( speed == true )
+            DataSpeedChange();
+       }
+    if ( set_time == true && SetTimeDate( &tm ) != HAL_OK )
+        return MB_ERROR_DEVICE;
+    return 0;
+ }
+
 //*********************************************************************************************
 // Перестановка в переменной uint16_t байт местами
 //*********************************************************************************************
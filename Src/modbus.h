@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+void ModbusInit( void );
 bool CheckFrame( uint8_t *data, uint8_t len );
+void ModbusImage( uint8_t meter );
 
 #endif
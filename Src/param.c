@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "param.h"
+#include "cmsis_os.h"
 #include "stm32f1xx_hal.h"
 
 //****************************************************************************************************************
@@ -12,6 +13,9 @@
 #define FLASH_DATA_ADDRESS      0x0801FC00      //адрес для хранения параметров
                                                 //последняя страница во FLASH (1Kb)
 
+#define MERC_NUMB_MAX           999999          //максимальный номер счетчика
+#define MERC_SPEED_MAX          4               //индекс максимальной скорости обмена со счетчиком (9600)
+
 //значения скорости для последовательных портов
 static const uint32_t dev_speed[] = { 600, 1200, 2400, 4800, 9600, 14400, 19200, 28800, 38400, 56000, 57600, 115200 };
 
@@ -25,18 +29,26 @@ static char * const flash_error[] = { "ОК",      "ERROR",  "BUSY",     "TIMEOU
 
 GlbConfig GlbConf;
 
+//изменение параметров и запись во FLASH выполняются из нескольких потоков (ModBus, клавиатура,
+//обмен со счетчиком), стирание страницы одним потоком во время записи другим портит параметры
+osMutexDef( MutexParam );
+static osMutexId mutex_param;
+
+//****************************************************************************************************************
+// Локальные прототипы функций
+//****************************************************************************************************************
+static uint8_t FlashWrite( void );
+
 //****************************************************************************************************************
 // Инициализация параметров настроек значениями из FLASH
 //****************************************************************************************************************
 uint8_t GlbParamInit( void ) {
 
     bool change = false;
-    uint8_t dw, dw_cnt;
-    uint32_t *source_addr, *dest_addr, err_addr;
-    uint32_t *ptr_glb, ptr_flash;
-    HAL_StatusTypeDef stat_flash;
-    FLASH_EraseInitTypeDef erase;
+    uint8_t dw, dw_cnt, idx;
+    uint32_t *source_addr, *dest_addr;
     
+    mutex_param = osMutexCreate( osMutex( MutexParam ) );
     source_addr = (uint32_t *)FLASH_DATA_ADDRESS;
     dest_addr = (uint32_t *)&GlbConf;
     dw_cnt = ( sizeof( GlbConf ) * 8 )/32;
@@ -71,34 +83,36 @@ uint8_t GlbParamInit( void ) {
         change = true;
         GlbConf.log_interval = 60;          //интервал логирования данных
        }
+    if ( !GlbConf.merc_count || GlbConf.merc_count > MERC_DEV_MAX ) {
+        change = true;
+        GlbConf.merc_count = 1;             //кол-во счетчиков на линии
+       }
+    if ( GlbConf.value_age == 0xFFFF || GlbConf.value_age < 10 ) {
+        change = true;
+        GlbConf.value_age = 300;            //максимальный возраст значений счетчика
+       }
+    if ( GlbConf.mbus_words == 0xFF ) {
+        change = true;
+        GlbConf.mbus_words = MBUS_WORDS_HIGH_FIRST; //порядок слов 32-битных значений ModBus
+       }
+    if ( GlbConf.log_sync == 0xFF ) {
+        change = true;
+        GlbConf.log_sync = 60;              //интервал сохранения буферов файлов данных
+       }
+    if ( GlbConf.log_format == 0xFF ) {
+        change = true;
+        GlbConf.log_format = LOG_FORMAT_CSV; //формат файлов текущих данных
+       }
+    for ( idx = 0; idx < MERC_DEV_MAX - 1; idx++ ) {
+        if ( GlbConf.merc_numb_add[idx] == 0xFFFFFFFF ) {
+            change = true;
+            GlbConf.merc_numb_add[idx] = 0; //номера дополнительных счетчиков
+           }
+       }
     if ( change == false )
         return HAL_OK;
-    //было изменение параметра, сохраним новое значения
-    //разблокируем память
-    stat_flash = HAL_FLASH_Unlock();
-    if ( stat_flash != HAL_OK )
-        return ERR_FLASH_UNLOCK | stat_flash;
-    //стирание памяти
-    erase.TypeErase = FLASH_TYPEERASE_PAGES;
-    erase.Banks = FLASH_BANK_1;
-    erase.PageAddress = FLASH_DATA_ADDRESS;
-    erase.NbPages = 1;
-    stat_flash = HAL_FLASHEx_Erase( &erase, &err_addr );
-    if ( stat_flash != HAL_OK )
-        return ERR_FLASH_ERASE | stat_flash;
-    //запись памяти по 4 байта (32 бита)
-    ptr_glb = (uint32_t *)&GlbConf;
-    ptr_flash = FLASH_DATA_ADDRESS;
-    for ( dw = 0; dw < dw_cnt; dw++, ptr_glb++, ptr_flash += 4 ) {
-        stat_flash = HAL_FLASH_Program( FLASH_TYPEPROGRAM_WORD, ptr_flash, *ptr_glb );    
-        if ( stat_flash != HAL_OK )
-            return ERR_FLASH_PROGRAMM | stat_flash;
-       }
-    //блокировка памяти
-    stat_flash = HAL_FLASH_Lock();
-    if ( stat_flash != HAL_OK )
-        return ERR_FLASH_LOCK | stat_flash;
-    return HAL_OK;
+    //было изменение параметра, сохраним новое значения (до запуска RTOS, без захвата параметров)
+    return FlashWrite();
  }
 
 //****************************************************************************************************************
@@ -129,23 +143,62 @@ uint32_t GlbParamGet( uint8_t id_param, uint8_t par_type ) {
         return GlbConf.log_enable;
     if ( id_param == GLB_LOG_INTERVAL )
         return GlbConf.log_interval;
+    if ( id_param == GLB_MERCURY_CNT )
+        return GlbConf.merc_count;
+    if ( id_param >= GLB_MERCURY_NUMB2 && id_param <= GLB_MERCURY_NUMB4 )
+        return GlbConf.merc_numb_add[id_param - GLB_MERCURY_NUMB2];
+    if ( id_param == GLB_VALUE_AGE )
+        return GlbConf.value_age;
+    if ( id_param == GLB_MBUS_WORDS )
+        return GlbConf.mbus_words;
+    if ( id_param == GLB_LOG_SYNC )
+        return GlbConf.log_sync;
+    if ( id_param == GLB_LOG_FORMAT )
+        return GlbConf.log_format;
     return 0;
  }
  
 //****************************************************************************************************************
-// Сохранить значение параметра во FLASH
-// uint8_t id_param                         - ID параметра
-// uint32_t value                           - значение параметра
-// return = HAL_OK                          - запись параметров выполнена
-//          ERR_FLASH_* | HAL_StatusTypeDef - маска источника ошибки и код ошибки  
+// Проверка значения параметра на допустимость, значение не сохраняется
+// uint8_t id_param - ID параметра
+// uint32_t value   - значение параметра, для GLB_MERCURY_SPEED и GLB_MBUS_SPEED - индекс скорости
+// return = true    - значение допустимо
 //****************************************************************************************************************
-uint8_t GlbParamSave( uint8_t id_param, uint32_t value ) {
+bool GlbParamCheck( uint8_t id_param, uint32_t value ) {
+
+    if ( id_param == GLB_MERCURY_NUMB || ( id_param >= GLB_MERCURY_NUMB2 && id_param <= GLB_MERCURY_NUMB4 ) )
+        return value <= MERC_NUMB_MAX;
+    if ( id_param == GLB_MERCURY_SPEED )
+        return value <= MERC_SPEED_MAX;
+    if ( id_param == GLB_MBUS_ID )
+        return value >= 1 && value <= 247;
+    if ( id_param == GLB_MBUS_SPEED )
+        return value < sizeof( dev_speed ) / sizeof( uint32_t );
+    if ( id_param == GLB_DATA_LOG )
+        return value <= 1;
+    if ( id_param == GLB_LOG_INTERVAL )
+        return value >= 5 && value <= UINT8_MAX;
+    if ( id_param == GLB_MERCURY_CNT )
+        return value && value <= MERC_DEV_MAX;
+    if ( id_param == GLB_VALUE_AGE )
+        return value >= 10 && value <= UINT16_MAX;
+    if ( id_param == GLB_MBUS_WORDS )
+        return value <= MBUS_WORDS_LOW_FIRST;
+    if ( id_param == GLB_LOG_SYNC )
+        return value < UINT8_MAX;
+    if ( id_param == GLB_LOG_FORMAT )
+        return value <= LOG_FORMAT_BIN;
+    return false;
+ }
+
+//****************************************************************************************************************
+// Изменить значение параметра только в RAM, запись во FLASH выполняет GlbParamCommit()
+// Позволяет изменить несколько параметров за один цикл стирания/записи FLASH
+// uint8_t id_param - ID параметра
+// uint32_t value   - значение параметра
+//****************************************************************************************************************
+void GlbParamSet( uint8_t id_param, uint32_t value ) {
 
-    uint8_t dw, dw_cnt;
-    uint32_t err_addr, *ptr_glb, ptr_flash;
-    HAL_StatusTypeDef stat_flash;
-    FLASH_EraseInitTypeDef erase;
-    
     //сохраним значение параметров в структуре PARAM
     if ( id_param == GLB_MERCURY_NUMB )
         GlbConf.merc_numb = value;
@@ -159,8 +212,82 @@ uint8_t GlbParamSave( uint8_t id_param, uint32_t value ) {
         GlbConf.log_enable = (bool)value;
     if ( id_param == GLB_LOG_INTERVAL )
         GlbConf.log_interval = value;
-    GlbConf.unused[0] = GlbConf.unused[1] = GlbConf.unused[2] = 0;
-    //сохраним параметры во FLASH
+    if ( id_param == GLB_MERCURY_CNT && value && value <= MERC_DEV_MAX )
+        GlbConf.merc_count = (uint8_t)value;
+    if ( id_param >= GLB_MERCURY_NUMB2 && id_param <= GLB_MERCURY_NUMB4 )
+        GlbConf.merc_numb_add[id_param - GLB_MERCURY_NUMB2] = value;
+    if ( id_param == GLB_VALUE_AGE && value >= 10 && value <= UINT16_MAX )
+        GlbConf.value_age = (uint16_t)value;
+    if ( id_param == GLB_MBUS_WORDS && value <= MBUS_WORDS_LOW_FIRST )
+        GlbConf.mbus_words = (uint8_t)value;
+    if ( id_param == GLB_LOG_SYNC && value < UINT8_MAX )
+        GlbConf.log_sync = (uint8_t)value;
+    if ( id_param == GLB_LOG_FORMAT && value <= LOG_FORMAT_BIN )
+        GlbConf.log_format = (uint8_t)value;
+ }
+
+//****************************************************************************************************************
+// Сохранить значение параметра во FLASH
+// uint8_t id_param                         - ID параметра
+// uint32_t value                           - значение параметра
+// return = HAL_OK                          - запись параметров выполнена
+//          ERR_FLASH_* | HAL_StatusTypeDef - маска источника ошибки и код ошибки  
+//****************************************************************************************************************
+uint8_t GlbParamSave( uint8_t id_param, uint32_t value ) {
+
+    uint8_t result;
+
+    GlbParamLock();
+    GlbParamSet( id_param, value );
+    result = GlbParamCommit();
+    GlbParamUnlock();
+    return result;
+ }
+
+//****************************************************************************************************************
+// Сохранить текущие значения всех параметров во FLASH (одно стирание страницы и запись)
+// return = HAL_OK                          - запись параметров выполнена
+//          ERR_FLASH_* | HAL_StatusTypeDef - маска источника ошибки и код ошибки  
+//****************************************************************************************************************
+uint8_t GlbParamCommit( void ) {
+
+    uint8_t result;
+
+    GlbParamLock();
+    result = FlashWrite();
+    GlbParamUnlock();
+    return result;
+ }
+
+//****************************************************************************************************************
+// Захват параметров потоком для изменения нескольких значений с последующей записью во FLASH
+// GlbParamSet() ... GlbParamCommit(), повторный захват тем же потоком допускается
+//****************************************************************************************************************
+void GlbParamLock( void ) {
+
+    osMutexWait( mutex_param, osWaitForever );
+ }
+
+//****************************************************************************************************************
+// Освобождение параметров после изменения, см. GlbParamLock()
+//****************************************************************************************************************
+void GlbParamUnlock( void ) {
+
+    osMutexRelease( mutex_param );
+ }
+
+//****************************************************************************************************************
+// Стирание страницы FLASH и запись текущих значений параметров, вызов только при захваченных параметрах
+// return = HAL_OK                          - запись параметров выполнена
+//          ERR_FLASH_* | HAL_StatusTypeDef - маска источника ошибки и код ошибки  
+//****************************************************************************************************************
+static uint8_t FlashWrite( void ) {
+
+    uint8_t dw, dw_cnt;
+    uint32_t err_addr, *ptr_glb, ptr_flash;
+    HAL_StatusTypeDef stat_flash;
+    FLASH_EraseInitTypeDef erase;
+    
     //разблокируем память
     stat_flash = HAL_FLASH_Unlock();
     if ( stat_flash != HAL_OK )
@@ -14,6 +14,24 @@
 #define GLB_MBUS_SPEED          4               //скорость обмена в сети MODBUS
 #define GLB_DATA_LOG            5               //признак логирования данных
 #define GLB_LOG_INTERVAL        6               //признак логирования данных
+#define GLB_MERCURY_CNT         7               //кол-во счетчиков на линии
+#define GLB_MERCURY_NUMB2       8               //номер второго счетчика
+#define GLB_MERCURY_NUMB3       9               //номер третьего счетчика
+#define GLB_MERCURY_NUMB4       10              //номер четвертого счетчика
+#define GLB_VALUE_AGE           11              //максимальный возраст значений счетчика (сек)
+#define GLB_MBUS_WORDS          12              //порядок слов 32-битных значений ModBus, см. MBUS_WORDS_*
+#define GLB_LOG_SYNC            13              //интервал сохранения данных из буферов файлов на карту (сек)
+#define GLB_LOG_FORMAT          14              //формат файлов текущих данных, см. LOG_FORMAT_*
+
+#define MERC_DEV_MAX            4               //максимальное кол-во счетчиков на линии
+
+//порядок слов 32-битных значений счетчика в регистрах ModBus
+#define MBUS_WORDS_HIGH_FIRST   0               //старшее слово первым
+#define MBUS_WORDS_LOW_FIRST    1               //младшее слово первым
+
+//формат файлов текущих данных счетчика
+#define LOG_FORMAT_CSV          0               //текстовый CSV: YYYYMMDD_dat.csv
+#define LOG_FORMAT_BIN          1               //двоичный: YYYYMMDD_dat.bin, см. LOG_BIN_HEADER, LOG_BIN_RECORD
 
 //Тип возвращаемого значения
 #define GLB_PARAM_INDEX         0               //только индекс параметра
@@ -44,7 +62,15 @@ typedef struct {
     uint8_t mbus_speed;                         //скорость обмена в сети MODBUS
     uint8_t log_enable;                         //признак логирования данных со счетчика на карту памяти
     uint8_t log_interval;                       //значение указывает интервал записи данных в секундах
-    uint8_t unused[3];                          //выравнивание структуры до 12 байт
+    uint8_t merc_count;                         //кол-во счетчиков на линии
+    uint16_t value_age;                         //максимальный возраст значений счетчика в секундах,
+                                                //более старые значения отмечаются как недостоверные
+    uint32_t merc_numb_add[MERC_DEV_MAX-1];     //номера дополнительных счетчиков
+    uint8_t mbus_words;                         //порядок слов 32-битных значений счетчика в регистрах MODBUS
+    uint8_t log_sync;                           //интервал сохранения данных из буферов открытых файлов на карту
+                                                //в секундах, 0 - после каждой записи
+    uint8_t log_format;                         //формат файлов текущих данных, см. LOG_FORMAT_*
+    uint8_t reserved[1];                        //выравнивание размера структуры до 4 байт
  } GlbConfig;
 
 #pragma pack( pop )
@@ -54,7 +80,12 @@ typedef struct {
 //****************************************************************************************************************
 uint8_t  GlbParamInit( void );
 uint32_t GlbParamGet( uint8_t id_param, uint8_t par_type );
+bool     GlbParamCheck( uint8_t id_param, uint32_t value );
+void     GlbParamSet( uint8_t id_param, uint32_t value );
 uint8_t  GlbParamSave( uint8_t id_param, uint32_t value );
+uint8_t  GlbParamCommit( void );
+void     GlbParamLock( void );
+void     GlbParamUnlock( void );
 uint32_t GlbValueIndex( uint8_t index );
 char    *FlashDescErr( uint8_t error );
 uint8_t  StatReset( void );
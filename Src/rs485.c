@@ -7,6 +7,7 @@
 #include "param.h"
 #include "events.h"
 #include "modbus.h"
+#include "crc16.h"
 #include "main.h"
 
 #include "cmsis_os.h"
@@ -15,141 +16,507 @@
 //****************************************************************************************************************
 // Локальные константы
 //****************************************************************************************************************
-#define RX_BUFFER_SIZE      255     //размер приемного буфера
+#define RX_RING_SIZE        256     //размер кольцевого буфера приема (DMA), степень 2
+#define RX_FRAME_SIZE       255     //размер буфера запроса
 
 #define THREAD_RECV         0       //режим приема запросов по шине RS485
-#define THREAD_SEND         1       //режим отправки ответов по шине RS485
+#define THREAD_SEND         1       //режим отправки ответов по шине RS485 (DE включен)
+
+//паузы между символами для скоростей выше 19200 фиксированные (Modbus over serial line, 2.5.1.1)
+#define GAP_SPEED_FIX       19200   //скорость, выше которой паузы фиксированные
+#define GAP_T15_FIX         750     //пауза t1.5 (мкс)
+#define GAP_T35_FIX         1750    //пауза t3.5 (мкс)
+#define GAP_CHAR_BITS       11      //кол-во бит символа для расчета пауз t1.5/t3.5
+#define GAP_IDLE_BITS       10      //длительность паузы IDLE в битах (формат 8N1)
+
+//состояние паузы на шине после приема байта
+#define GAP_NONE            0       //пауза не контролируется
+#define GAP_T10             1       //пауза больше символа (IDLE), ожидание t1.5
+#define GAP_T15             2       //пауза больше t1.5, ожидание t3.5
+
+//этапы обработки запроса для статистики времени ответа
+#define LAT_NONE            0       //запрос не обрабатывается
+#define LAT_CHECK           1       //запрос передан в CheckFrame()
+#define LAT_SEND            2       //запущена передача ответа
+
+#define LAT_HIST_UNIT       100     //единица шкалы гистограммы времени ответа (мкс)
+
+//****************************************************************************************************************
+// Локальные типы данных
+//****************************************************************************************************************
+//статистика времени ответа для группы функций, время в мкс
+typedef struct {
+    uint32_t cnt;                           //кол-во ответов
+    uint32_t min;                           //время ответа: конец запроса - начало передачи ответа
+    uint32_t max;
+    uint32_t sum;                           //сумма для расчета среднего значения
+    uint32_t wait;                          //максимальное время конец запроса - начало обработки
+    uint32_t proc;                          //максимальное время обработки запроса
+    uint32_t total;                         //максимальное время конец запроса - завершение передачи
+    uint32_t hist[MBUS_HIST_CNT];           //гистограмма времени ответа, см. LatencyIndex()
+ } LATENCY;
 
 //****************************************************************************************************************
 // Внешние переменные
 //****************************************************************************************************************
 extern UART_HandleTypeDef huart1;
+extern TIM_HandleTypeDef htim3;
 
 //****************************************************************************************************************
 // Локальные переменные
 //****************************************************************************************************************
-static uint8_t cnt_timer = 0, mode = THREAD_RECV; 
-static uint8_t rx_buffer[RX_BUFFER_SIZE];
-osThreadId tid_Thread485Recv, tid_Thread485Send;
+static volatile uint8_t mode = THREAD_RECV; 
+static uint8_t rx_ring[RX_RING_SIZE];       //кольцевой буфер приема, заполняется DMA
+static uint8_t rx_frame[RX_FRAME_SIZE];     //запрос, скопированный из кольцевого буфера
+static volatile uint16_t rx_tail = 0;       //позиция начала текущего фрейма в кольцевом буфере
+static volatile uint16_t frame_beg = 0;     //позиция начала принятого фрейма
+static volatile uint16_t frame_len = 0;     //размер принятого фрейма
+static volatile uint16_t gap_pos = 0;       //позиция DMA на момент паузы t1.5
+static uint16_t crc_pos = 0;                //позиция первого байта, не включенного в расчет КС
+static CRC16_RUN rx_crc;                    //КС текущего фрейма, см. CrcUpdate()
+static volatile bool frame_crc = false;     //результат проверки КС принятого фрейма
+static volatile uint8_t gap_state = GAP_NONE;
+static volatile bool frame_error = false;
+static uint16_t gap_t15, gap_t35;           //паузы t1.5, t3.5 от момента IDLE (мкс)
+
+//метки времени обработки запроса: счетчик тактов DWT (свободный счет, переполнение учитывается
+//при вычитании), конец запроса - окончание последнего байта запроса
+static volatile uint32_t time_idle = 0;     //метка последнего прерывания IDLE
+static volatile uint32_t frame_time = 0;    //метка IDLE принятого фрейма
+static uint32_t time_end, time_check, time_send;
+static uint32_t idle_cycles;                //длительность паузы IDLE в тактах
+static uint32_t cycles_us;                  //кол-во тактов в 1 мкс
+static volatile uint8_t lat_state = LAT_NONE;
+static uint8_t lat_func;                    //индекс группы функции текущего запроса
+static LATENCY latency[MBUS_FUNC_CNT];
+static uint16_t diag_cnt[MBUS_CNT_MAX];     //счетчики диагностики линии, см. MBUS_CNT_*
+//функции, для которых статистика ведется отдельно, остальные - в последней группе
+static const uint8_t lat_code[MBUS_FUNC_CNT - 1] = { 0x03, 0x06, 0x10 };
+osThreadId tid_Thread485Recv;
 
 //****************************************************************************************************************
 // Локальные прототипы функций
 //****************************************************************************************************************
-static uint8_t RecvCnt( void );
-static void ClearRecvBuff( void );
+static uint16_t RecvPos( void );
+static void RecvStart( void );
+static void FrameStart( uint16_t pos );
+static void CrcUpdate( uint16_t pos );
+static void SendDone( void );
+static void GapInit( uint32_t speed );
+static void GapStart( void );
+static void LatencyAdd( void );
+static uint8_t LatencyFunc( uint8_t func );
+static uint8_t LatencyIndex( uint32_t time );
 
 static void Thread485Recv( void const *arg );
-static void Thread485Send( void const *arg );
 
 osThreadDef( Thread485Recv, osPriorityNormal, 1, 0 );
-osThreadDef( Thread485Send, osPriorityNormal, 1, 0 );
 
 //*****************************************************************************************
 // Инициализация интерфейса RS485
 //*****************************************************************************************
 void RS485Init( void ) {
 
-    memset( rx_buffer, 0x00, sizeof( rx_buffer ) );
+    memset( rx_ring, 0x00, sizeof( rx_ring ) );
+    memset( rx_frame, 0x00, sizeof( rx_frame ) );
+    
+    RS485LatencyReset();
+    RS485CountReset();
+    //счетчик тактов DWT - метки времени статистики времени ответа
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    cycles_us = SystemCoreClock / 1000000;
     
     tid_Thread485Recv = osThreadCreate( osThread( Thread485Recv ), NULL );
-    tid_Thread485Send = osThreadCreate( osThread( Thread485Send ), NULL );
 
+    GapInit( GlbParamGet( GLB_MBUS_SPEED, GLB_PARAM_VALUE ) );
     HAL_GPIO_WritePin( RS485_CTRL_GPIO_Port, RS485_CTRL_Pin, GPIO_PIN_RESET );
-    HAL_UART_Receive_IT( &huart1, rx_buffer, sizeof( rx_buffer ) );
+    RecvStart();
+    //прерывание по паузе на линии RX - запуск контроля пауз t1.5/t3.5
+    __HAL_UART_ENABLE_IT( &huart1, UART_IT_IDLE );
+ }
+
+//*****************************************************************************************
+// Расчет пауз t1.5/t3.5 для скорости обмена, паузы отсчитываются от прерывания IDLE, 
+// которое формируется после паузы длительностью в один символ
+// uint32_t speed - скорость обмена
+//*****************************************************************************************
+static void GapInit( uint32_t speed ) {
+
+    uint32_t t15, t35, idle;
+
+    if ( !speed )
+        speed = GAP_SPEED_FIX;
+    if ( speed > GAP_SPEED_FIX ) {
+        t15 = GAP_T15_FIX;
+        t35 = GAP_T35_FIX;
+       }
+    else {
+        t15 = ( GAP_CHAR_BITS * 3 * 1000000UL ) / ( 2 * speed );
+        t35 = ( GAP_CHAR_BITS * 7 * 1000000UL ) / ( 2 * speed );
+       }
+    idle = ( GAP_IDLE_BITS * 1000000UL ) / speed;
+    idle_cycles = ( SystemCoreClock / speed ) * GAP_IDLE_BITS;
+    gap_t15 = t15 > idle ? t15 - idle : 1;
+    gap_t35 = t35 > idle ? t35 - idle : 2;
+ }
+
+//*****************************************************************************************
+// Перезапуск однократного таймера контроля пауз: CC1 - пауза t1.5, обновление - пауза t3.5
+// Вызов из RS485Irq()
+//*****************************************************************************************
+static void GapStart( void ) {
+
+    __HAL_TIM_DISABLE( &htim3 );
+    __HAL_TIM_SET_COUNTER( &htim3, 0 );
+    __HAL_TIM_SET_COMPARE( &htim3, TIM_CHANNEL_1, gap_t15 );
+    __HAL_TIM_SET_AUTORELOAD( &htim3, gap_t35 );
+    __HAL_TIM_CLEAR_FLAG( &htim3, TIM_FLAG_CC1 | TIM_FLAG_UPDATE );
+    __HAL_TIM_ENABLE_IT( &htim3, TIM_IT_CC1 | TIM_IT_UPDATE );
+    __HAL_TIM_ENABLE( &htim3 );
  }
 
 //**********************************************************************************
-// Кол-во принятых байт по UART1
+// Запуск приема UART1 в кольцевой буфер (DMA в циклическом режиме)
 //**********************************************************************************
-static uint8_t RecvCnt( void ) {
+static void RecvStart( void ) {
 
-    return huart1.pRxBuffPtr - (uint8_t *)rx_buffer;
+    FrameStart( 0 );
+    HAL_UART_Receive_DMA( &huart1, rx_ring, sizeof( rx_ring ) );
+    //прерывание по половине буфера не используется
+    __HAL_DMA_DISABLE_IT( huart1.hdmarx, DMA_IT_HT );
  }
 
 //**********************************************************************************
-// Чистим приемный буфер
+// Текущая позиция записи DMA в кольцевом буфере приема
 //**********************************************************************************
-static void ClearRecvBuff( void ) {
+static uint16_t RecvPos( void ) {
 
-    memset( rx_buffer, 0x00, sizeof( rx_buffer ) );
-    huart1.RxXferCount = sizeof( rx_buffer );
-    huart1.pRxBuffPtr = (uint8_t*)rx_buffer;
+    return ( RX_RING_SIZE - __HAL_DMA_GET_COUNTER( huart1.hdmarx ) ) & ( RX_RING_SIZE - 1 );
+ }
+
+//**********************************************************************************
+// Начало приема фрейма с указанной позиции кольцевого буфера
+//**********************************************************************************
+static void FrameStart( uint16_t pos ) {
+
+    rx_tail = crc_pos = pos;
+    CRC16Start( &rx_crc );
+ }
+
+//**********************************************************************************
+// Расчет КС текущего фрейма по байтам, принятым до указанной позиции кольцевого буфера
+// КС рассчитывается в прерываниях по мере приема (DMA не формирует прерываний по
+// каждому байту - расчет по паузе IDLE), при завершении фрейма проверка КС - одно сравнение
+// Вызов из RS485Irq(), RS485Gap()
+//**********************************************************************************
+static void CrcUpdate( uint16_t pos ) {
+
+    while ( crc_pos != pos ) {
+        CRC16Add( &rx_crc, rx_ring[crc_pos] );
+        crc_pos = ( crc_pos + 1 ) & ( RX_RING_SIZE - 1 );
+       }
  }
 
 //*****************************************************************************************
 // Поток ослеживает прием запроса по RS485
+// Запрос обрабатывается по сигналу о паузе t3.5 на шине после приема, см. RS485Gap()
 //*****************************************************************************************
 static void Thread485Recv( void const *arg ) {
 
-    uint8_t rc;
+    bool crc_ok;
+    uint16_t beg, len, part;
     
     while ( true ) {
-        osDelay( 1 );
+        osSignalWait( EVN_485_RECV, osWaitForever );
         if ( mode == THREAD_SEND )
             continue;
-        rc = RecvCnt();
-        if ( rc && cnt_timer > 1 ) {
-            //проверка запроса, формирование ответа
-            CheckFrame( rx_buffer, rc ); 
-            //независимо от результата проверки текущего запроса 
-            //очистим буфер для приема следующего запроса
-            ClearRecvBuff();
+        //параметры фрейма читаются одной записью: RS485Gap() может опубликовать следующий фрейм
+        __disable_irq();
+        beg = frame_beg;
+        len = frame_len;
+        crc_ok = frame_crc;
+        time_end = frame_time;
+        __enable_irq();
+        if ( !len )
+            continue;
+        time_end -= idle_cycles;
+        time_check = DWT->CYCCNT;
+        //проверка КС (рассчитана при приеме, см. CrcUpdate())
+        if ( len < 4 || !crc_ok ) {
+            diag_cnt[MBUS_CNT_BUS_ERR]++;
+            continue;
            }
-                
-       }
- }
-
-//*****************************************************************************************
-// Поток контролирует завершение передачи ответа по RS485
-//*****************************************************************************************
-static void Thread485Send( void const *arg ) {
-
-    while ( true ) {
-        if ( mode == THREAD_RECV )
+        //копируем фрейм из кольцевого буфера с учетом перехода через конец буфера
+        part = RX_RING_SIZE - beg;
+        if ( part >= len )
+            memcpy( rx_frame, rx_ring + beg, len );
+        else {
+            memcpy( rx_frame, rx_ring + beg, part );
+            memcpy( rx_frame + part, rx_ring, len - part );
+           }
+        //DMA продолжает запись в кольцевой буфер: при задержке обработки байты фрейма могут быть 
+        //перезаписаны следующими фреймами на шине, КС проверяется повторно по скопированному фрейму
+        if ( CalcCRC16( rx_frame, len - 2 ) != ( rx_frame[len - 2] | ( rx_frame[len - 1] << 8 ) ) ) {
+            diag_cnt[MBUS_CNT_OVERRUN]++;
             continue;
-        //проверяем завершение отправки пакета
-        if ( !huart1.TxXferCount && huart1.gState == HAL_UART_STATE_READY ) {
-            HAL_GPIO_WritePin( RS485_CTRL_GPIO_Port, RS485_CTRL_Pin, GPIO_PIN_RESET );
-            mode = THREAD_RECV;
+           }
+        //проверка адреса уст-ва
+        diag_cnt[MBUS_CNT_BUS_MSG]++;
+        if ( rx_frame[0] != GlbParamGet( GLB_MBUS_ID, GLB_PARAM_VALUE ) )
+            continue; //фрейм не для нас
+        diag_cnt[MBUS_CNT_SRV_MSG]++;
+        //проверка запроса, формирование ответа
+        lat_func = LatencyFunc( rx_frame[1] );
+        lat_state = LAT_CHECK;
+        CheckFrame( rx_frame, len ); 
+        if ( lat_state == LAT_CHECK ) {
+            //ответ на запрос не передавался
+            diag_cnt[MBUS_CNT_NO_RESP]++;
+            lat_state = LAT_NONE;
            }
        }
  }
 
 //*****************************************************************************************
-// Иницирует передачу блока данных в последовательный порт
+// Иницирует передачу блока данных в последовательный порт через DMA,
+// буфер должен оставаться неизменным до завершения передачи
 // char *data       - адрес исходного буфера с данными 
 // uint8_t len_data - размер передаваемого блока
 //*****************************************************************************************
 void RS485Send( uint8_t *data, uint8_t len_data ) {
 
-    cnt_timer = 0; //перезапуск таймера паузы
+    time_send = DWT->CYCCNT;
+    if ( lat_state == LAT_CHECK )
+        lat_state = LAT_SEND;
+    if ( len_data > 1 && ( data[1] & 0x80 ) )
+        diag_cnt[MBUS_CNT_EXCEPTION]++; //ответ с ошибкой
     HAL_GPIO_WritePin( RS485_CTRL_GPIO_Port, RS485_CTRL_Pin, GPIO_PIN_SET );
     mode = THREAD_SEND;
-    HAL_UART_Transmit_IT( &huart1, data, len_data );
+    if ( HAL_UART_Transmit_DMA( &huart1, data, len_data ) != HAL_OK )
+        SendDone(); //передача не запущена, шина освобождается сразу
  } 
 
 //*****************************************************************************************
-// Инкремент таймера для определения паузы на шине MODBUS
-// Вызов из TIM1_UP_IRQHandler() stm32f1xx_it.c
-// Параметры Timer1: F = 500 Hz; T = 2 ms; t = 1 ms
+// Завершение передачи ответа: выключение передатчика RS485, переход в режим приема
+// Байты, принятые во время передачи, в следующий запрос не попадают
+//*****************************************************************************************
+static void SendDone( void ) {
+
+    HAL_GPIO_WritePin( RS485_CTRL_GPIO_Port, RS485_CTRL_Pin, GPIO_PIN_RESET );
+    FrameStart( RecvPos() );
+    mode = THREAD_RECV;
+    if ( lat_state == LAT_SEND )
+        LatencyAdd();
+    lat_state = LAT_NONE;
+ }
+
+//*****************************************************************************************
+// Передача UART1 завершена: последний стоп-бит выдан на линию (прерывание TC),
+// передатчик RS485 выключается сразу в прерывании
+// Вызов из HAL_UART_IRQHandler()
+//*****************************************************************************************
+void HAL_UART_TxCpltCallback( UART_HandleTypeDef *huart ) {
+
+    if ( huart == &huart1 )
+        SendDone();
+ }
+
+//*****************************************************************************************
+// Обработка событий таймера контроля пауз на шине MODBUS
+// Пауза t1.5 - байты, принятые после паузы, делают запрос недействительным (фрейм отбрасывается)
+// Пауза t3.5 - прием запроса завершен, фрейм передается потоку обработки запроса
+// Прием байтов между t1.5 и t3.5 контролируется по счетчику DMA
+// Вызов из TIM3_IRQHandler() stm32f1xx_it.c
 //*****************************************************************************************
-void RS485Timer( void ) {
+void RS485Gap( void ) {
 
-    if ( cnt_timer < 255 )
-        cnt_timer++;
+    uint16_t pos;
+
+    if ( __HAL_TIM_GET_FLAG( &htim3, TIM_FLAG_CC1 ) ) {
+        __HAL_TIM_CLEAR_FLAG( &htim3, TIM_FLAG_CC1 );
+        if ( gap_state == GAP_T10 ) {
+            gap_state = GAP_T15;
+            gap_pos = RecvPos();
+           }
+       }
+    if ( __HAL_TIM_GET_FLAG( &htim3, TIM_FLAG_UPDATE ) ) {
+        __HAL_TIM_CLEAR_FLAG( &htim3, TIM_FLAG_UPDATE );
+        if ( gap_state == GAP_NONE )
+            return;
+        pos = RecvPos();
+        if ( pos != gap_pos ) {
+            //байт принят после паузы t1.5, фрейм будет отброшен по следующей паузе
+            frame_error = true;
+            return;
+           }
+        gap_state = GAP_NONE;
+        if ( frame_error == true ) {
+            //внутри фрейма была пауза больше t1.5 или ошибка приема
+            frame_error = false;
+            FrameStart( pos );
+            diag_cnt[MBUS_CNT_BUS_ERR]++;
+            return;
+           }
+        CrcUpdate( pos );
+        frame_time = time_idle;
+        frame_crc = CRC16Check( &rx_crc );
+        frame_beg = rx_tail;
+        frame_len = ( pos - rx_tail ) & ( RX_RING_SIZE - 1 );
+        FrameStart( pos );
+        osSignalSet( tid_Thread485Recv, EVN_485_RECV );
+       }
  }
  
 //****************************************************************************************************************
-// Перезапуск таймера.
-// Проверка на переполнение буфера данных. Вызывается при приеме и передаче.
+// Контроль паузы на линии RX. Вызывается при приеме и передаче.
 // Вызов из USART1_IRQHandler() stm32f1xx_it.c
 //****************************************************************************************************************
 void RS485Irq( void ) {
 
-    cnt_timer = 0; //перезапуск таймера паузы
-    if ( mode == THREAD_SEND )
-        return; //во время передачи игнорируем обработку
-    //проверка на переполнение буфера
-    if ( RecvCnt() > sizeof( rx_buffer ) - 1 )
-        ClearRecvBuff();
+    if ( __HAL_UART_GET_FLAG( &huart1, UART_FLAG_IDLE ) ) {
+        __HAL_UART_CLEAR_IDLEFLAG( &huart1 );
+        if ( mode == THREAD_RECV ) {
+            //пауза после приема байта, если предыдущая пауза уже превысила t1.5 - фрейм ошибочный
+            time_idle = DWT->CYCCNT;
+            if ( gap_state == GAP_T15 )
+                frame_error = true;
+            gap_state = GAP_T10;
+            GapStart();
+            //расчет КС по принятым байтам во время паузы t1.5/t3.5
+            CrcUpdate( RecvPos() );
+           }
+       }
+ }
+
+//****************************************************************************************************************
+// Ошибка приема UART (переполнение, шум, ошибка кадра): HAL останавливает DMA приема,
+// текущий фрейм отбрасывается, прием в кольцевой буфер запускается заново
+//****************************************************************************************************************
+void HAL_UART_ErrorCallback( UART_HandleTypeDef *huart ) {
+
+    if ( huart != &huart1 )
+        return;
+    if ( HAL_UART_GetError( huart ) & HAL_UART_ERROR_ORE )
+        diag_cnt[MBUS_CNT_OVERRUN]++;
+    frame_error = true;
+    RecvStart();
+ }
+
+//****************************************************************************************************************
+// Учет времени ответа на запрос по меткам времени обработки запроса
+// Вызов из SendDone() по завершению передачи ответа
+//****************************************************************************************************************
+static void LatencyAdd( void ) {
+
+    LATENCY *lat;
+    uint32_t resp, wait, proc, total;
+
+    total = ( DWT->CYCCNT - time_end ) / cycles_us;
+    resp = ( time_send - time_end ) / cycles_us;
+    wait = ( time_check - time_end ) / cycles_us;
+    proc = ( time_send - time_check ) / cycles_us;
+    lat = &latency[lat_func];
+    if ( !lat->cnt || resp < lat->min )
+        lat->min = resp;
+    if ( resp > lat->max )
+        lat->max = resp;
+    if ( wait > lat->wait )
+        lat->wait = wait;
+    if ( proc > lat->proc )
+        lat->proc = proc;
+    if ( total > lat->total )
+        lat->total = total;
+    lat->sum += resp;
+    lat->cnt++;
+    lat->hist[LatencyIndex( resp / LAT_HIST_UNIT )]++;
+ }
+
+//****************************************************************************************************************
+// Индекс группы статистики для кода функции запроса
+//****************************************************************************************************************
+static uint8_t LatencyFunc( uint8_t func ) {
+
+    uint8_t idx;
+
+    for ( idx = 0; idx < sizeof( lat_code ); idx++ ) {
+        if ( lat_code[idx] == func )
+            return idx;
+       }
+    return MBUS_FUNC_CNT - 1;
+ }
+
+//****************************************************************************************************************
+// Возвращает индекс интервала гистограммы времени ответа (логарифмическая шкала)
+// uint32_t time - время (LAT_HIST_UNIT мкс)
+// return        - индекс интервала 0 - MBUS_HIST_CNT-1
+//****************************************************************************************************************
+static uint8_t LatencyIndex( uint32_t time ) {
+
+    uint8_t index = 0;
+
+    while ( time && index < MBUS_HIST_CNT - 1 ) {
+        time >>= 1;
+        index++;
+       }
+    return index;
+ }
+
+//****************************************************************************************************************
+// Возвращает значение статистики времени ответа на запросы MODBUS
+// uint8_t func  - группа функций (0 - MBUS_FUNC_CNT-1): 0x03, 0x06, 0x10, остальные функции
+// uint8_t value - значение, см. MBUS_LAT_*, для гистограммы MBUS_LAT_HIST + интервал:
+//                 0 - менее 100 мкс, N - от 2^(N-1) * 100 до 2^N * 100 - 1 мкс, 
+//                 последний интервал - все большие значения
+// return        - значение (мкс или кол-во ответов)
+//****************************************************************************************************************
+uint32_t RS485Latency( uint8_t func, uint8_t value ) {
+
+    LATENCY *lat;
+
+    if ( func >= MBUS_FUNC_CNT || value >= MBUS_LAT_CNT )
+        return 0;
+    lat = &latency[func];
+    if ( value >= MBUS_LAT_HIST )
+        return lat->hist[value - MBUS_LAT_HIST];
+    switch ( value ) {
+        case MBUS_LAT_COUNT: return lat->cnt;
+        case MBUS_LAT_MIN:   return lat->min;
+        case MBUS_LAT_AVG:   return lat->cnt ? lat->sum / lat->cnt : 0;
+        case MBUS_LAT_MAX:   return lat->max;
+        case MBUS_LAT_WAIT:  return lat->wait;
+        case MBUS_LAT_PROC:  return lat->proc;
+        case MBUS_LAT_TOTAL: return lat->total;
+       }
+    return 0;
+ }
+
+//****************************************************************************************************************
+// Сброс статистики времени ответа на запросы MODBUS
+// Запрос сброса выполняется в потоке Thread485Recv до передачи ответа, 
+// поэтому одновременного обновления статистики в SendDone() не возникает
+//****************************************************************************************************************
+void RS485LatencyReset( void ) {
+
+    memset( latency, 0x00, sizeof( latency ) );
+ }
+
+//****************************************************************************************************************
+// Возвращает значение счетчика диагностики линии MODBUS
+// uint8_t counter - счетчик, см. MBUS_CNT_*
+//****************************************************************************************************************
+uint16_t RS485Count( uint8_t counter ) {
+
+    if ( counter >= MBUS_CNT_MAX )
+        return 0;
+    return diag_cnt[counter];
+ }
+
+//****************************************************************************************************************
+// Сброс счетчиков диагностики линии MODBUS
+//****************************************************************************************************************
+void RS485CountReset( void ) {
+
+    memset( diag_cnt, 0x00, sizeof( diag_cnt ) );
  }
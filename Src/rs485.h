@@ -4,12 +4,44 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+//****************************************************************************************************************
+// Счетчики диагностики линии MODBUS (функция 0x08), значения 16 бит
+//****************************************************************************************************************
+#define MBUS_CNT_BUS_MSG        0       //кол-во фреймов на линии с правильной КС
+#define MBUS_CNT_BUS_ERR        1       //кол-во ошибок связи: ошибка КС, пауза внутри фрейма
+#define MBUS_CNT_EXCEPTION      2       //кол-во ответов с ошибкой
+#define MBUS_CNT_SRV_MSG        3       //кол-во запросов к уст-ву
+#define MBUS_CNT_NO_RESP        4       //кол-во запросов к уст-ву без ответа
+#define MBUS_CNT_OVERRUN        5       //кол-во ошибок переполнения приемника UART и кольцевого буфера
+#define MBUS_CNT_MAX            6       //кол-во счетчиков
+
+//****************************************************************************************************************
+// Статистика времени ответа на запросы MODBUS
+//****************************************************************************************************************
+#define MBUS_FUNC_CNT           4       //кол-во групп статистики: функции 0x03, 0x06, 0x10, остальные
+#define MBUS_HIST_CNT           12      //кол-во интервалов гистограммы времени ответа
+
+//значения статистики группы функций, время в мкс
+#define MBUS_LAT_COUNT          0       //кол-во ответов
+#define MBUS_LAT_MIN            1       //минимальное время ответа: конец запроса - начало передачи ответа
+#define MBUS_LAT_AVG            2       //среднее время ответа
+#define MBUS_LAT_MAX            3       //максимальное время ответа
+#define MBUS_LAT_WAIT           4       //максимальное время конец запроса - начало обработки потоком приема
+#define MBUS_LAT_PROC           5       //максимальное время обработки запроса (проверка КС - RS485Send)
+#define MBUS_LAT_TOTAL          6       //максимальное время конец запроса - завершение передачи ответа
+#define MBUS_LAT_HIST           7       //гистограмма времени ответа, MBUS_HIST_CNT значений
+#define MBUS_LAT_CNT            ( MBUS_LAT_HIST + MBUS_HIST_CNT )
+
 //****************************************************************************************************************
 // Прототипы функций
 //****************************************************************************************************************
 void RS485Init( void );
 void RS485Irq( void );
-void RS485Timer( void );
+void RS485Gap( void );
 void RS485Send( uint8_t *data, uint8_t len_data );
+uint32_t RS485Latency( uint8_t func, uint8_t value );
+uint16_t RS485Count( uint8_t counter );
+void RS485CountReset( void );
+void RS485LatencyReset( void );
 
 #endif
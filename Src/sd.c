@@ -20,6 +20,7 @@
 extern SPI_HandleTypeDef hspi1;
 sd_info_ptr sdinfo;
 char str1[60] = { 0 };
+static uint32_t write_cnt = 0; //кол-во записанных блоков
 
 //*********************************************************************************************
 //
@@ -166,9 +167,18 @@ uint8_t SD_Write_Block( uint8_t *buff, uint32_t lba ) {
        } while ( ( result != 0xFF ) && ( cnt<0xFFFF ) );
     if ( cnt >= 0xFFFF ) 
         return 6;
+    write_cnt++;
     return 0;
  }
 
+//*********************************************************************************************
+// Кол-во блоков, записанных на карту с момента включения
+//*********************************************************************************************
+uint32_t SD_Write_Count( void ) {
+
+    return write_cnt;
+ }
+
 //*********************************************************************************************
 //
 //*********************************************************************************************
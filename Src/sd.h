@@ -41,6 +41,7 @@ uint8_t sd_ini(void);
 void SPI_Release(void);
 uint8_t SD_Read_Block (uint8_t *buff, uint32_t lba);
 uint8_t SD_Write_Block (uint8_t *buff, uint32_t lba);
+uint32_t SD_Write_Count(void);
 uint8_t SPI_wait_ready(void);
 
 #endif
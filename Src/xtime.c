@@ -85,6 +85,18 @@ void GetTimeDate( timedate *ptr ) {
     SecToDtime( secsarg, ptr );
  }
 
+//****************************************************************************************************************
+// Возвращает текущее значение часов в секундах от 01.01.1970
+//****************************************************************************************************************
+uint32_t GetTimeSec( void ) {
+
+    uint32_t high, low; 
+    
+    high = READ_REG( hrtc.Instance->CNTH & RTC_CNTH_RTC_CNT );
+    low = READ_REG( hrtc.Instance->CNTL & RTC_CNTL_RTC_CNT );
+    return ( high << 16 ) | low;
+ }
+
 //****************************************************************************************************************
 // Устанавливает новое значение дата/время
 // struct timedate *ptr - указатель на структуру содежащую значение для установки дата/время
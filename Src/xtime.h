@@ -31,6 +31,7 @@ typedef struct {
 //****************************************************************************************************************
 void RTCInit( void );
 void GetTimeDate( timedate *ptr );
+uint32_t GetTimeSec( void );
 uint8_t SetTimeDate( timedate *ptr );
 uint8_t RTCCheckDate( timedate *ptr );
 char *GetDateTimeStr( void );
@@ -0,0 +1,196 @@
+//****************************************************************************************************************
+//
+// Проверка и замер времени преобразования BCD значений ответов счетчика (Src/bcd.c)
+//
+// Сборка:         cc -O2 -o bcdtest bcdtest.c ../Src/bcd.c
+// Использование:  bcdtest
+//
+// Для всех значений длиной 1-4 байта (все комбинации байт) сравнивает BCDToInt() с прежним преобразованием:
+// перестановка байт SWAP16()/SWAP32()/power[0]<->power[2] и сложение тетрад с весом 10^n от младшего байта.
+// Проверяет, что BCDCheck() отклоняет все значения с тетрадой больше 9. Выводит время вызова обоих вариантов.
+//
+//****************************************************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Src/bcd.h"
+
+//****************************************************************************************************************
+// Локальные константы
+//****************************************************************************************************************
+#define SWAP16( val )          ( (((val) & 0xFF00) >> 8) | (((val) & 0x00FF) << 8) )
+#define SWAP32( val )          ( (((val) & 0xFF) << 24) | (((val) & 0xFF00) << 8) | (((val) & 0xFF0000) >> 8) | (((val) >> 24) & 0xFF) )
+
+#define BENCH_VALUES            4096        //кол-во значений для замера времени
+#define BENCH_LOOPS             4096        //кол-во проходов по значениям
+
+//****************************************************************************************************************
+// Локальные прототипы функций
+//****************************************************************************************************************
+static uint32_t OldBCDToInt( uint8_t *ptr, uint8_t cnt_byte );
+static uint32_t OldDecode( uint8_t *ptr, uint8_t cnt_byte );
+static bool NibbleCheck( uint8_t *ptr, uint8_t cnt_byte );
+static bool Verify( uint8_t cnt_byte );
+static void Bench( uint8_t cnt_byte );
+
+volatile uint32_t sink;
+
+//****************************************************************************************************************
+// Проверка всех значений 1-4 байта, замер времени
+//****************************************************************************************************************
+int main( void ) {
+
+    uint8_t cnt_byte;
+    bool result = true;
+
+    for ( cnt_byte = 1; cnt_byte <= 4; cnt_byte++ )
+        result &= Verify( cnt_byte );
+    for ( cnt_byte = 1; cnt_byte <= 4; cnt_byte++ )
+        Bench( cnt_byte );
+    printf( result ? "PASS\n" : "FAIL\n" );
+    return result ? 0 : 1;
+ }
+
+//****************************************************************************************************************
+// Прежнее преобразование: байты от младшего к старшему, вес тетрады 10^n
+// uint8_t *ptr     - указатель на младший байт числа
+// uint8_t cnt_byte - кол-во байт для преобразования
+//****************************************************************************************************************
+static uint32_t OldBCDToInt( uint8_t *ptr, uint8_t cnt_byte ) {
+
+    uint8_t i, low, high;
+    uint32_t dec = 1, result = 0;
+  
+    for ( i = 0; i < cnt_byte; i++, ptr++ ) {
+        low = ( (*ptr) & 0x0F );
+        result += low * dec;
+        dec *= 10;
+        high = ( ( (*ptr) & 0xF0 ) >> 4 );
+        result += high * dec;
+        dec *= 10;
+       }
+    return result;
+ }
+
+//****************************************************************************************************************
+// Прежний разбор ответа счетчика: значение (старшим байтом вперед) копируется в переменную, байты 
+// переставляются в зависимости от размера, после чего выполняется OldBCDToInt()
+// uint8_t *ptr     - указатель на первый (старший) байт числа в ответе
+// uint8_t cnt_byte - кол-во байт числа
+//****************************************************************************************************************
+static uint32_t OldDecode( uint8_t *ptr, uint8_t cnt_byte ) {
+
+    uint8_t byte, temp, power[3];
+    uint16_t word;
+    uint32_t dword;
+
+    if ( cnt_byte == 1 ) {
+        byte = *ptr;
+        return OldBCDToInt( &byte, sizeof( byte ) );
+       }
+    if ( cnt_byte == 2 ) {
+        memcpy( &word, ptr, sizeof( word ) );
+        word = SWAP16( word );
+        return OldBCDToInt( (uint8_t *)&word, sizeof( word ) );
+       }
+    if ( cnt_byte == 3 ) {
+        memcpy( power, ptr, sizeof( power ) );
+        temp = power[0];
+        power[0] = power[2];
+        power[2] = temp;
+        return OldBCDToInt( power, sizeof( power ) );
+       }
+    memcpy( &dword, ptr, sizeof( dword ) );
+    dword = SWAP32( dword );
+    return OldBCDToInt( (uint8_t *)&dword, sizeof( dword ) );
+ }
+
+//****************************************************************************************************************
+// Проверка тетрад без таблицы
+// return - true - все тетрады 0-9
+//****************************************************************************************************************
+static bool NibbleCheck( uint8_t *ptr, uint8_t cnt_byte ) {
+
+    for ( ; cnt_byte; cnt_byte--, ptr++ ) {
+        if ( ( *ptr >> 4 ) > 9 || ( *ptr & 0x0F ) > 9 )
+            return false;
+       }
+    return true;
+ }
+
+//****************************************************************************************************************
+// Проверка всех комбинаций байт значения заданной длины
+// uint8_t cnt_byte - кол-во байт значения
+// return           - true - расхождений нет
+//****************************************************************************************************************
+static bool Verify( uint8_t cnt_byte ) {
+
+    uint8_t idx, data[4];
+    uint64_t code, last;
+    bool valid;
+    uint32_t cnt_valid = 0, cnt_invalid = 0, cnt_error = 0;
+
+    last = (uint64_t)1 << ( cnt_byte * 8 );
+    for ( code = 0; code < last; code++ ) {
+        for ( idx = 0; idx < cnt_byte; idx++ )
+            data[idx] = code >> ( ( cnt_byte - 1 - idx ) * 8 );
+        valid = NibbleCheck( data, cnt_byte );
+        if ( BCDCheck( data, cnt_byte ) != valid ) {
+            if ( cnt_error++ < 10 )
+                printf( "  BCDCheck mismatch: %0*llX\n", cnt_byte * 2, (unsigned long long)code );
+            continue;
+           }
+        if ( valid == false ) {
+            cnt_invalid++;
+            continue;
+           }
+        cnt_valid++;
+        if ( BCDToInt( data, cnt_byte ) != OldDecode( data, cnt_byte ) && cnt_error++ < 10 )
+            printf( "  BCDToInt mismatch: %0*llX: %u != %u\n", cnt_byte * 2, (unsigned long long)code,
+                    BCDToInt( data, cnt_byte ), OldDecode( data, cnt_byte ) );
+       }
+    printf( "%u byte: valid %u, rejected %u, errors %u\n", cnt_byte, cnt_valid, cnt_invalid, cnt_error );
+    return cnt_error == 0;
+ }
+
+//****************************************************************************************************************
+// Замер времени преобразования случайных допустимых значений
+// uint8_t cnt_byte - кол-во байт значения
+//****************************************************************************************************************
+static void Bench( uint8_t cnt_byte ) {
+
+    static uint8_t data[BENCH_VALUES][4];
+    uint32_t idx, loop, sum;
+    uint8_t pos;
+    clock_t start;
+    double time_old, time_new;
+
+    srand( 1 );
+    for ( idx = 0; idx < BENCH_VALUES; idx++ ) {
+        for ( pos = 0; pos < cnt_byte; pos++ )
+            data[idx][pos] = ( rand() % 10 ) << 4 | ( rand() % 10 );
+       }
+    sum = 0;
+    start = clock();
+    for ( loop = 0; loop < BENCH_LOOPS; loop++ ) {
+        for ( idx = 0; idx < BENCH_VALUES; idx++ )
+            sum += OldDecode( data[idx], cnt_byte );
+       }
+    time_old = (double)( clock() - start ) / CLOCKS_PER_SEC;
+    sink = sum;
+    sum = 0;
+    start = clock();
+    for ( loop = 0; loop < BENCH_LOOPS; loop++ ) {
+        for ( idx = 0; idx < BENCH_VALUES; idx++ )
+            sum += BCDToInt( data[idx], cnt_byte );
+       }
+    time_new = (double)( clock() - start ) / CLOCKS_PER_SEC;
+    sink = sum;
+    printf( "%u byte: old %.2f ns/call, table %.2f ns/call\n", cnt_byte, time_old * 1e9 / BENCH_VALUES / BENCH_LOOPS,
+            time_new * 1e9 / BENCH_VALUES / BENCH_LOOPS );
+ }
@@ -0,0 +1,299 @@
+//****************************************************************************************************************
+//
+// Проверка и замер скорости вариантов расчета КС MODBUS (Src/crc16.c, см. CRC16_ENGINE_*)
+//
+// Сборка: crc16.c компилируется отдельно для каждого значения CRC16_ENGINE (0 - 3) с переименованием
+// внешних функций, программа проверки собирается из всех вариантов:
+//   for e in 0 1 2 3; do cc -O2 -c -DCRC16_ENGINE=$e -o crc16_$e.o crc16bench.c; done
+//   cc -O2 -o crc16bench crc16bench.c crc16_0.o crc16_1.o crc16_2.o crc16_3.o
+// Использование: crc16bench
+//
+// Каждый вариант сравнивается с исходным расчетом по таблицам ref_high/ref_low: контрольный
+// запрос MODBUS 01 03 00 00 00 0A (КС 0xCDC5), случайные данные длиной 0 - 260 байт с произвольным
+// выравниванием, расчет по мере приема CRC16Start()/CRC16Add()/CRC16Check(), поправка КС при 
+// замене части байтов CRC16ShiftInit()/CRC16Patch(). Для каждого варианта выводится скорость расчета: байт за такт (счетчик TSC на x86) и MB/s.
+//
+//****************************************************************************************************************
+
+#if defined( CRC16_ENGINE )
+
+//****************************************************************************************************************
+// Вариант расчета из Src/crc16.c, внешние функции получают суффикс варианта: CalcCRC16_0 ...
+//****************************************************************************************************************
+#define ENGINE_NAME( name, engine )     ENGINE_PASTE( name, engine )
+#define ENGINE_PASTE( name, engine )    name##_##engine
+
+#define CalcCRC16                       ENGINE_NAME( CalcCRC16, CRC16_ENGINE )
+#define CRC16Start                      ENGINE_NAME( CRC16Start, CRC16_ENGINE )
+#define CRC16Add                        ENGINE_NAME( CRC16Add, CRC16_ENGINE )
+#define CRC16Check                      ENGINE_NAME( CRC16Check, CRC16_ENGINE )
+#define CRC16ShiftInit                  ENGINE_NAME( CRC16ShiftInit, CRC16_ENGINE )
+#define CRC16Patch                      ENGINE_NAME( CRC16Patch, CRC16_ENGINE )
+
+#include "../Src/crc16.c"
+
+#else
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+#include "../Src/crc16.h"
+
+//****************************************************************************************************************
+// Локальные константы
+//****************************************************************************************************************
+#define RANDOM_CNT              100000      //кол-во случайных векторов для проверки
+#define RANDOM_LEN_MAX          260         //максимальная длина случайного вектора
+#define PATCH_LEN_MAX           8           //максимальное кол-во заменяемых байтов для CRC16Patch()
+#define BENCH_LEN               256         //длина блока для замера скорости (максимальный фрейм MODBUS)
+#define BENCH_LOOPS             200000      //кол-во расчетов блока для замера скорости
+
+//****************************************************************************************************************
+// Локальные типы данных
+//****************************************************************************************************************
+typedef struct {
+    const char *name;
+    uint16_t ( *calc )( uint8_t *buf, uint16_t len );
+    void ( *start )( CRC16_RUN *run );
+    void ( *add )( CRC16_RUN *run, uint8_t byte );
+    bool ( *check )( const CRC16_RUN *run );
+    void ( *shift_init )( uint16_t *shift, uint16_t len );
+    uint16_t ( *patch )( uint16_t crc, const uint8_t *delta, uint8_t len, const uint16_t *shift );
+ } ENGINE;
+
+//****************************************************************************************************************
+// Варианты расчета, см. CRC16_ENGINE_*
+//****************************************************************************************************************
+#define ENGINE_PROTO( n )   uint16_t CalcCRC16_##n( uint8_t *buf, uint16_t len ); void CRC16Start_##n( CRC16_RUN *run ); \
+                            void CRC16Add_##n( CRC16_RUN *run, uint8_t byte ); bool CRC16Check_##n( const CRC16_RUN *run ); \
+                            void CRC16ShiftInit_##n( uint16_t *shift, uint16_t len ); \
+                            uint16_t CRC16Patch_##n( uint16_t crc, const uint8_t *delta, uint8_t len, const uint16_t *shift );
+#define ENGINE_DESC( n, s ) { s, CalcCRC16_##n, CRC16Start_##n, CRC16Add_##n, CRC16Check_##n, CRC16ShiftInit_##n, CRC16Patch_##n }
+
+ENGINE_PROTO( 0 )
+ENGINE_PROTO( 1 )
+ENGINE_PROTO( 2 )
+ENGINE_PROTO( 3 )
+
+static const ENGINE engine[] = {
+    ENGINE_DESC( 0, "BYTE  " ),
+    ENGINE_DESC( 1, "WORD  " ),
+    ENGINE_DESC( 2, "SLICE4" ),
+    ENGINE_DESC( 3, "NIBBLE" )
+ };
+
+#define ENGINE_CNT  ( sizeof( engine ) / sizeof( ENGINE ) )
+
+//****************************************************************************************************************
+// Исходные таблицы расчета КС, названия по описанию протокола MODBUS: ref_high (auchCRCHi) содержит
+// младшие байты значений, ref_low (auchCRCLo) - старшие, см. table_low/table_high в Src/crc16.c
+//****************************************************************************************************************
+static const uint8_t ref_high[256] = {
+    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
+    0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
+    0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
+    0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81,
+    0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
+    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01,
+    0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
+    0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
+    0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
+    0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+    0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
+    0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
+    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01,
+    0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
+    0x40
+ };
+
+static const uint8_t ref_low[256] = {
+    0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7, 0x05, 0xC5, 0xC4,
+    0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E, 0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09,
+    0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9, 0x1B, 0xDB, 0xDA, 0x1A, 0x1E, 0xDE, 0xDF, 0x1F, 0xDD,
+    0x1D, 0x1C, 0xDC, 0x14, 0xD4, 0xD5, 0x15, 0xD7, 0x17, 0x16, 0xD6, 0xD2, 0x12, 0x13, 0xD3,
+    0x11, 0xD1, 0xD0, 0x10, 0xF0, 0x30, 0x31, 0xF1, 0x33, 0xF3, 0xF2, 0x32, 0x36, 0xF6, 0xF7,
+    0x37, 0xF5, 0x35, 0x34, 0xF4, 0x3C, 0xFC, 0xFD, 0x3D, 0xFF, 0x3F, 0x3E, 0xFE, 0xFA, 0x3A,
+    0x3B, 0xFB, 0x39, 0xF9, 0xF8, 0x38, 0x28, 0xE8, 0xE9, 0x29, 0xEB, 0x2B, 0x2A, 0xEA, 0xEE,
+    0x2E, 0x2F, 0xEF, 0x2D, 0xED, 0xEC, 0x2C, 0xE4, 0x24, 0x25, 0xE5, 0x27, 0xE7, 0xE6, 0x26,
+    0x22, 0xE2, 0xE3, 0x23, 0xE1, 0x21, 0x20, 0xE0, 0xA0, 0x60, 0x61, 0xA1, 0x63, 0xA3, 0xA2,
+    0x62, 0x66, 0xA6, 0xA7, 0x67, 0xA5, 0x65, 0x64, 0xA4, 0x6C, 0xAC, 0xAD, 0x6D, 0xAF, 0x6F,
+    0x6E, 0xAE, 0xAA, 0x6A, 0x6B, 0xAB, 0x69, 0xA9, 0xA8, 0x68, 0x78, 0xB8, 0xB9, 0x79, 0xBB,
+    0x7B, 0x7A, 0xBA, 0xBE, 0x7E, 0x7F, 0xBF, 0x7D, 0xBD, 0xBC, 0x7C, 0xB4, 0x74, 0x75, 0xB5,
+    0x77, 0xB7, 0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71, 0x70, 0xB0, 0x50, 0x90, 0x91,
+    0x51, 0x93, 0x53, 0x52, 0x92, 0x96, 0x56, 0x57, 0x97, 0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C,
+    0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E, 0x5A, 0x9A, 0x9B, 0x5B, 0x99, 0x59, 0x58, 0x98, 0x88,
+    0x48, 0x49, 0x89, 0x4B, 0x8B, 0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D, 0x4C, 0x8C,
+    0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83, 0x41, 0x81, 0x80,
+    0x40
+ };
+
+//****************************************************************************************************************
+// Локальные прототипы функций
+//****************************************************************************************************************
+static uint16_t RefCRC16( uint8_t *buf, uint16_t len );
+static bool Verify( const ENGINE *eng );
+static void Bench( const char *name, uint16_t ( *calc )( uint8_t *buf, uint16_t len ) );
+static uint64_t Cycles( void );
+
+volatile uint16_t sink;
+
+//****************************************************************************************************************
+// Проверка и замер скорости всех вариантов расчета
+//****************************************************************************************************************
+int main( void ) {
+
+    uint8_t idx;
+    bool result = true;
+
+    for ( idx = 0; idx < ENGINE_CNT; idx++ )
+        result &= Verify( &engine[idx] );
+    Bench( "ORIGIN", RefCRC16 );
+    for ( idx = 0; idx < ENGINE_CNT; idx++ )
+        Bench( engine[idx].name, engine[idx].calc );
+    printf( result ? "PASS\n" : "FAIL\n" );
+    return result ? 0 : 1;
+ }
+
+//****************************************************************************************************************
+// Исходный расчет контрольной суммы
+// uint8_t *buf - адрес буфера с данными для подсчета CRC
+// uint16_t len - размер данных 
+// return       - контрольная сумма
+//****************************************************************************************************************
+static uint16_t RefCRC16( uint8_t *buf, uint16_t len ) {
+
+    uint16_t index;
+    uint8_t high = 0xFF, low = 0xFF;
+    
+    while ( len-- ) {
+        index = low ^ *buf++;
+        low = high ^ ref_high[index];
+        high = ref_low[index];
+       }
+    return high << 8 | low;
+ }
+
+//****************************************************************************************************************
+// Проверка варианта расчета
+// const ENGINE *eng - вариант расчета
+// return            - true - расхождений нет
+//****************************************************************************************************************
+static bool Verify( const ENGINE *eng ) {
+
+    CRC16_RUN run;
+    uint16_t crc, len, pos, beg, cnt_patch, shift[CRC16_SHIFT_SIZE];
+    uint32_t cnt, cnt_error = 0;
+    uint8_t *ptr, buff[RANDOM_LEN_MAX + 8], delta[PATCH_LEN_MAX];
+    uint8_t frame[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+
+    //контрольный запрос MODBUS
+    if ( eng->calc( frame, sizeof( frame ) ) != 0xCDC5 || RefCRC16( frame, sizeof( frame ) ) != 0xCDC5 ) {
+        printf( "  %s: reference frame CRC %04X\n", eng->name, eng->calc( frame, sizeof( frame ) ) );
+        cnt_error++;
+       }
+    srand( 1 );
+    for ( cnt = 0; cnt < RANDOM_CNT; cnt++ ) {
+        //случайные данные со случайным смещением от выровненного адреса
+        len = rand() % ( RANDOM_LEN_MAX + 1 );
+        ptr = buff + rand() % 4;
+        for ( pos = 0; pos < len; pos++ )
+            ptr[pos] = rand();
+        crc = RefCRC16( ptr, len );
+        if ( eng->calc( ptr, len ) != crc ) {
+            if ( cnt_error++ < 10 )
+                printf( "  %s: len %u CRC %04X != %04X\n", eng->name, len, eng->calc( ptr, len ), crc );
+            continue;
+           }
+        //замена части байтов, поправка КС по разности байтов
+        if ( len ) {
+            beg = rand() % len;
+            cnt_patch = 1 + rand() % ( len - beg < PATCH_LEN_MAX ? len - beg : PATCH_LEN_MAX );
+            for ( pos = 0; pos < cnt_patch; pos++ ) {
+                delta[pos] = rand();
+                ptr[beg + pos] ^= delta[pos];
+               }
+            eng->shift_init( shift, len - beg - cnt_patch );
+            crc = eng->patch( crc, delta, cnt_patch, shift );
+            if ( crc != RefCRC16( ptr, len ) ) {
+                if ( cnt_error++ < 10 )
+                    printf( "  %s: len %u patch %u at %u CRC %04X != %04X\n", eng->name, len, cnt_patch, beg, crc, RefCRC16( ptr, len ) );
+                continue;
+               }
+           }
+        //фрейм с КС (младший байт первым), расчет по мере приема
+        if ( len > RANDOM_LEN_MAX - 2 )
+            continue;
+        ptr[len] = crc & 0xFF;
+        ptr[len + 1] = crc >> 8;
+        eng->start( &run );
+        for ( pos = 0; pos < len + 2; pos++ )
+            eng->add( &run, ptr[pos] );
+        if ( eng->check( &run ) == false && cnt_error++ < 10 )
+            printf( "  %s: len %u running CRC failed\n", eng->name, len );
+        //искажение одного бита обнаруживается всегда
+        pos = rand() % ( len + 2 );
+        ptr[pos] ^= 1 << ( rand() % 8 );
+        eng->start( &run );
+        for ( pos = 0; pos < len + 2; pos++ )
+            eng->add( &run, ptr[pos] );
+        if ( eng->check( &run ) == true && cnt_error++ < 10 )
+            printf( "  %s: len %u running CRC missed error\n", eng->name, len );
+       }
+    printf( "%s: %u vectors, errors %u\n", eng->name, RANDOM_CNT, cnt_error );
+    return cnt_error == 0;
+ }
+
+//****************************************************************************************************************
+// Замер скорости расчета КС блока BENCH_LEN байт
+// const char *name - наименование варианта
+// calc             - функция расчета
+//****************************************************************************************************************
+static void Bench( const char *name, uint16_t ( *calc )( uint8_t *buf, uint16_t len ) ) {
+
+    uint32_t loop;
+    uint16_t pos, crc = 0;
+    uint64_t cycles;
+    clock_t start;
+    double time, bytes;
+    uint8_t buff[BENCH_LEN];
+
+    for ( pos = 0; pos < BENCH_LEN; pos++ )
+        buff[pos] = pos * 7 + 3;
+    start = clock();
+    cycles = Cycles();
+    for ( loop = 0; loop < BENCH_LOOPS; loop++ ) {
+        buff[0] = loop;
+        crc ^= calc( buff, BENCH_LEN );
+       }
+    cycles = Cycles() - cycles;
+    time = (double)( clock() - start ) / CLOCKS_PER_SEC;
+    sink = crc;
+    bytes = (double)BENCH_LEN * BENCH_LOOPS;
+    if ( cycles )
+        printf( "%s: %.3f bytes/cycle, %.1f MB/s\n", name, bytes / cycles, bytes / time / 1e6 );
+    else printf( "%s: %.1f MB/s\n", name, bytes / time / 1e6 );
+ }
+
+//****************************************************************************************************************
+// Счетчик тактов процессора, 0 - счетчик недоступен
+//****************************************************************************************************************
+static uint64_t Cycles( void ) {
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __rdtsc();
+#else
+    return 0;
+#endif
+ }
+
+#endif
@@ -0,0 +1,295 @@
+//****************************************************************************************************************
+//
+// Преобразование двоичных файлов текущих данных счетчика (YYYYMMDD_dat.bin) в CSV
+//
+// Сборка:         cc -O2 -o logconv logconv.c
+// Использование:  logconv [-f] [-o каталог] путь ...
+//   путь          - каталог карты, каталог месяца YYYYMM или файл .bin, каталоги обходятся рекурсивно
+//   -f            - перезаписывать существующие файлы CSV
+//   -o каталог    - каталог для файлов CSV, по умолчанию файл CSV создается рядом с файлом .bin
+//
+// Формат CSV совпадает с файлами YYYYMMDD_dat.csv, которые контроллер ведет в режиме LOG_FORMAT_CSV.
+// Формат файла описан в Src/dataloger.h, значения little-endian.
+//
+//****************************************************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "../Src/dataloger.h"
+
+//****************************************************************************************************************
+// Локальные константы
+//****************************************************************************************************************
+#define PATH_SIZE               1024        //размер буфера имени файла
+#define ROW_SIZE                64          //максимальный размер строки CSV
+#define CSV_TITLE               "Date;Time;Voltage;Current;Power;Age;Valid\r\n"
+
+//****************************************************************************************************************
+// Локальные переменные
+//****************************************************************************************************************
+static bool overwrite = false;
+static char *out_dir = NULL;
+static uint32_t cnt_file, cnt_skip, cnt_error, cnt_rec;
+
+//****************************************************************************************************************
+// Локальные прототипы функций
+//****************************************************************************************************************
+static void ConvertPath( const char *path );
+static void ConvertFile( const char *path );
+static bool IsDataFile( const char *name );
+static uint32_t GetLE( const uint8_t *ptr, uint8_t size );
+static char *PutDec( char *dst, uint32_t value, uint8_t digits );
+
+//****************************************************************************************************************
+// Разбор параметров командной строки, обход указанных путей
+//****************************************************************************************************************
+int main( int argc, char *argv[] ) {
+
+    int idx;
+    bool path = false;
+
+    for ( idx = 1; idx < argc; idx++ ) {
+        if ( !strcmp( argv[idx], "-f" ) )
+            overwrite = true;
+        else if ( !strcmp( argv[idx], "-o" ) && idx + 1 < argc )
+            out_dir = argv[++idx];
+        else {
+            path = true;
+            ConvertPath( argv[idx] );
+           }
+       }
+    if ( path == false ) {
+        fprintf( stderr, "usage: logconv [-f] [-o dir] path ...\n" );
+        return 2;
+       }
+    printf( "files: %u, records: %u, skipped: %u, errors: %u\n", cnt_file, cnt_rec, cnt_skip, cnt_error );
+    return cnt_error ? 1 : 0;
+ }
+
+//****************************************************************************************************************
+// Преобразует файл или все файлы данных каталога (с подкаталогами)
+// const char *path - имя каталога или файла
+//****************************************************************************************************************
+static void ConvertPath( const char *path ) {
+
+    DIR *dir;
+    struct stat st;
+    struct dirent *ent;
+    char name[PATH_SIZE];
+
+    if ( stat( path, &st ) ) {
+        fprintf( stderr, "%s: not found\n", path );
+        cnt_error++;
+        return;
+       }
+    if ( !S_ISDIR( st.st_mode ) ) {
+        ConvertFile( path );
+        return;
+       }
+    dir = opendir( path );
+    if ( dir == NULL ) {
+        fprintf( stderr, "%s: can't open directory\n", path );
+        cnt_error++;
+        return;
+       }
+    while ( ( ent = readdir( dir ) ) != NULL ) {
+        if ( ent->d_name[0] == '.' )
+            continue;
+        snprintf( name, sizeof( name ), "%s/%s", path, ent->d_name );
+        if ( stat( name, &st ) )
+            continue;
+        if ( S_ISDIR( st.st_mode ) )
+            ConvertPath( name );
+        else if ( IsDataFile( ent->d_name ) == true )
+            ConvertFile( name );
+       }
+    closedir( dir );
+ }
+
+//****************************************************************************************************************
+// Проверяет имя файла текущих данных: YYYYMMDD_dat.bin, YYYYMMDD_dat2.bin ...
+// const char *name - имя файла без каталога
+// return           - true - файл текущих данных
+//****************************************************************************************************************
+static bool IsDataFile( const char *name ) {
+
+    size_t len;
+
+    len = strlen( name );
+    if ( len < 4 || strcmp( name + len - 4, ".bin" ) )
+        return false;
+    return strstr( name, "_dat" ) != NULL;
+ }
+
+//****************************************************************************************************************
+// Преобразует двоичный файл текущих данных в файл CSV с тем же именем и расширением .csv
+// Файл читается целиком, строки CSV формируются без printf() в одном буфере и записываются одной операцией.
+// Неполная последняя запись (файл не закрыт контроллером) пропускается.
+// const char *path - имя файла .bin
+//****************************************************************************************************************
+static void ConvertFile( const char *path ) {
+
+    FILE *file;
+    long size;
+    uint8_t *data, *rec;
+    uint32_t time, value, cnt, idx;
+    uint8_t hdr_size, rec_size;
+    char date[11], *csv, *ptr;
+    const char *base;
+    char name[PATH_SIZE];
+
+    //имя файла CSV
+    base = strrchr( path, '/' );
+    if ( out_dir != NULL )
+        snprintf( name, sizeof( name ), "%s/%s", out_dir, base != NULL ? base + 1 : path );
+    else snprintf( name, sizeof( name ), "%s", path );
+    ptr = strrchr( name, '.' );
+    if ( ptr == NULL || strlen( ptr ) != 4 ) {
+        fprintf( stderr, "%s: bad name\n", path );
+        cnt_error++;
+        return;
+       }
+    strcpy( ptr, ".csv" );
+    if ( overwrite == false && ( file = fopen( name, "rb" ) ) != NULL ) {
+        fclose( file );
+        cnt_skip++;
+        return;
+       }
+    //чтение файла целиком
+    file = fopen( path, "rb" );
+    if ( file == NULL ) {
+        fprintf( stderr, "%s: can't open\n", path );
+        cnt_error++;
+        return;
+       }
+    fseek( file, 0, SEEK_END );
+    size = ftell( file );
+    fseek( file, 0, SEEK_SET );
+    data = malloc( size > 0 ? size : 1 );
+    if ( data == NULL || fread( data, 1, size, file ) != (size_t)size ) {
+        fprintf( stderr, "%s: read error\n", path );
+        fclose( file );
+        free( data );
+        cnt_error++;
+        return;
+       }
+    fclose( file );
+    //проверка заголовка, размеры заголовка и записи берутся из файла: следующие версии формата
+    //могут добавлять поля в конец заголовка и записи
+    hdr_size = size >= (long)sizeof( LOG_BIN_HEADER ) ? data[5] : 0;
+    rec_size = size >= (long)sizeof( LOG_BIN_HEADER ) ? data[6] : 0;
+    if ( size < (long)sizeof( LOG_BIN_HEADER ) || memcmp( data, LOG_BIN_MAGIC, 4 ) || data[4] < LOG_BIN_VERSION ||
+         hdr_size < sizeof( LOG_BIN_HEADER ) || hdr_size > size || rec_size < sizeof( LOG_BIN_RECORD ) ) {
+        fprintf( stderr, "%s: bad header\n", path );
+        free( data );
+        cnt_error++;
+        return;
+       }
+    //дата файла: DD.MM.YYYY
+    ptr = PutDec( date, data[11], 2 );
+    *ptr++ = '.';
+    ptr = PutDec( ptr, data[10], 2 );
+    *ptr++ = '.';
+    PutDec( ptr, GetLE( data + 8, 2 ), 4 );
+    cnt = ( size - hdr_size ) / rec_size;
+    csv = malloc( sizeof( CSV_TITLE ) + (size_t)cnt * ROW_SIZE );
+    if ( csv == NULL ) {
+        fprintf( stderr, "%s: out of memory\n", path );
+        free( data );
+        cnt_error++;
+        return;
+       }
+    memcpy( csv, CSV_TITLE, sizeof( CSV_TITLE ) - 1 );
+    ptr = csv + sizeof( CSV_TITLE ) - 1;
+    for ( idx = 0, rec = data + hdr_size; idx < cnt; idx++, rec += rec_size ) {
+        time = GetLE( rec, 4 );
+        //дата и время
+        memcpy( ptr, date, 10 );
+        ptr += 10;
+        *ptr++ = ';';
+        value = time & LOG_BIN_TIME_MASK;
+        ptr = PutDec( ptr, value / 3600, 2 );
+        *ptr++ = ':';
+        ptr = PutDec( ptr, value / 60 % 60, 2 );
+        *ptr++ = ':';
+        ptr = PutDec( ptr, value % 60, 2 );
+        *ptr++ = ';';
+        //напряжение 0.1 V
+        value = GetLE( rec + 4, 2 );
+        ptr = PutDec( ptr, value / 10, 0 );
+        *ptr++ = '.';
+        ptr = PutDec( ptr, value % 10, 1 );
+        *ptr++ = ';';
+        //ток 0.01 A
+        value = GetLE( rec + 6, 2 );
+        ptr = PutDec( ptr, value / 100, 0 );
+        *ptr++ = '.';
+        ptr = PutDec( ptr, value % 100, 2 );
+        *ptr++ = ';';
+        //мощность, возраст, достоверность
+        ptr = PutDec( ptr, GetLE( rec + 8, 2 ), 0 );
+        *ptr++ = ';';
+        ptr = PutDec( ptr, GetLE( rec + 10, 2 ), 0 );
+        *ptr++ = ';';
+        *ptr++ = ( time & LOG_BIN_VALID ) ? '1' : '0';
+        *ptr++ = '\r';
+        *ptr++ = '\n';
+       }
+    free( data );
+    file = fopen( name, "wb" );
+    if ( file == NULL || fwrite( csv, 1, ptr - csv, file ) != (size_t)( ptr - csv ) ) {
+        fprintf( stderr, "%s: write error\n", name );
+        if ( file != NULL )
+            fclose( file );
+        free( csv );
+        cnt_error++;
+        return;
+       }
+    fclose( file );
+    free( csv );
+    cnt_file++;
+    cnt_rec += cnt;
+ }
+
+//****************************************************************************************************************
+// Возвращает значение little-endian
+// const uint8_t *ptr - значение в файле
+// uint8_t size       - размер значения (байт)
+//****************************************************************************************************************
+static uint32_t GetLE( const uint8_t *ptr, uint8_t size ) {
+
+    uint32_t value = 0;
+
+    while ( size-- )
+        value = ( value << 8 ) | ptr[size];
+    return value;
+ }
+
+//****************************************************************************************************************
+// Выводит десятичное значение
+// char *dst      - буфер
+// uint32_t value - значение
+// uint8_t digits - минимальное кол-во цифр с ведущими нулями, 0 - без ведущих нулей
+// return         - указатель на следующий символ в буфере
+//****************************************************************************************************************
+static char *PutDec( char *dst, uint32_t value, uint8_t digits ) {
+
+    char str[10];
+    uint8_t len = 0;
+
+    do {
+        str[len++] = '0' + value % 10;
+        value /= 10;
+       } while ( value );
+    while ( len < digits )
+        str[len++] = '0';
+    while ( len )
+        *dst++ = str[--len];
+    return dst;
+ }